@@ -0,0 +1,265 @@
+#pragma once
+
+#include <stdexec/execution.hpp>
+
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+/*
+Asynchronous generator: the body can co_await senders and awaitables, each co_yield hands a value to the consumer
+which pulls them with `while(auto value = co_await generator.next())`.
+The body runs ahead of the consumer until DEPTH values are buffered, then it is parked until the consumer takes one.
+The body is started by the first next() and runs on whatever thread resumes it, so it should begin with
+co_await stdexec::schedule(...) if the values are expensive to produce.
+requestStop() (or destroying the generator) stops it at the next co_yield, the buffered values are dropped.
+Until then buffered() still counts them, with the value of that last co_yield, so the consumer can account for them.
+A generator destroyed while its body runs leaves the body to finish alone, so when the body uses anything owned
+by the consumer co_await close() first: it stops the body and resumes once the body can't run anymore.
+*/
+template<std::movable T, uint32_t DEPTH = 2>
+class AsyncGenerator
+{
+    static_assert(DEPTH > 0, "Prefetch depth must be at least one");
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct YieldAwaiter
+    {
+        T value;
+        bool await_ready() { return false; }
+        std::coroutine_handle<> await_suspend(Handle producer)
+        {
+            promise_type& promise = producer.promise();
+            std::unique_lock lock(promise.mutex);
+            if(promise.detached)
+            {
+                lock.unlock();
+                producer.destroy();
+                return std::noop_coroutine();
+            }
+            std::coroutine_handle<> consumer = std::exchange(promise.consumer, nullptr);
+            // Kept even when stopped, next() doesn't hand it out but buffered() counts it
+            promise.items.push_back(std::move(value));
+            if(consumer)
+            {
+                // The consumer restarts us after taking the value
+                promise.parked = true;
+                return consumer;
+            }
+            if(promise.stop_requested == false && promise.items.size() < DEPTH)
+            {
+                return producer;
+            }
+            promise.parked = true;
+            std::coroutine_handle<> closer = std::exchange(promise.closer, nullptr);
+            return closer ? closer : std::noop_coroutine();
+        }
+        void await_resume() {}
+    };
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle producer) noexcept
+        {
+            promise_type& promise = producer.promise();
+            std::unique_lock lock(promise.mutex);
+            if(promise.detached)
+            {
+                lock.unlock();
+                producer.destroy();
+                return std::noop_coroutine();
+            }
+            promise.finished = true;
+            std::coroutine_handle<> consumer = std::exchange(promise.consumer, nullptr);
+            std::coroutine_handle<> closer = std::exchange(promise.closer, nullptr);
+            return consumer ? consumer : (closer ? closer : std::noop_coroutine());
+        }
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type : stdexec::with_awaitable_senders<promise_type>
+    {
+        AsyncGenerator get_return_object() { return AsyncGenerator{Handle::from_promise(*this)}; }
+        static std::suspend_always initial_suspend() noexcept { return {}; }
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        YieldAwaiter yield_value(T value) { return YieldAwaiter{std::move(value)}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+
+        std::mutex mutex;
+        std::deque<T> items;
+        std::coroutine_handle<> consumer;
+        // Waits in close() until the body is parked or finished
+        std::coroutine_handle<> closer;
+        std::exception_ptr exception;
+        bool started {false};
+        // Suspended at a co_yield, only the consumer (or the destructor) can continue it
+        bool parked {false};
+        bool finished {false};
+        bool stop_requested {false};
+        // The generator was destroyed while the body was running, the body destroys itself when it suspends
+        bool detached {false};
+    };
+
+    struct [[nodiscard]] NextAwaiter
+    {
+        Handle producer;
+        bool await_ready()
+        {
+            std::lock_guard lock(producer.promise().mutex);
+            return hasResult(producer.promise());
+        }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer)
+        {
+            promise_type& promise = producer.promise();
+            std::lock_guard lock(promise.mutex);
+            if(hasResult(promise))
+            {
+                return consumer;
+            }
+            promise.consumer = consumer;
+            if(promise.started == false || promise.parked)
+            {
+                promise.started = true;
+                promise.parked = false;
+                return producer;
+            }
+            return std::noop_coroutine();
+        }
+        std::optional<T> await_resume()
+        {
+            promise_type& promise = producer.promise();
+            std::unique_lock lock(promise.mutex);
+            if(promise.stop_requested)
+            {
+                return std::nullopt;
+            }
+            if(promise.items.empty())
+            {
+                if(promise.exception)
+                {
+                    std::rethrow_exception(promise.exception);
+                }
+                return std::nullopt;
+            }
+            std::optional<T> value {std::move(promise.items.front())};
+            promise.items.pop_front();
+            const bool restart = std::exchange(promise.parked, false);
+            lock.unlock();
+            if(restart)
+            {
+                producer.resume();
+            }
+            return value;
+        }
+        static bool hasResult(const promise_type& promise)
+        {
+            return promise.items.empty() == false || promise.finished || promise.stop_requested;
+        }
+    };
+    struct [[nodiscard]] CloseAwaiter
+    {
+        Handle producer;
+        bool await_ready()
+        {
+            if(!producer)
+            {
+                return true;
+            }
+            std::lock_guard lock(producer.promise().mutex);
+            producer.promise().stop_requested = true;
+            return isSuspended(producer.promise());
+        }
+        bool await_suspend(std::coroutine_handle<> closer)
+        {
+            promise_type& promise = producer.promise();
+            std::lock_guard lock(promise.mutex);
+            if(isSuspended(promise))
+            {
+                return false;
+            }
+            promise.closer = closer;
+            return true;
+        }
+        void await_resume() {}
+    };
+
+    AsyncGenerator() = default;
+    explicit AsyncGenerator(Handle coroutine)
+    : m_coroutine(coroutine)
+    {}
+    AsyncGenerator(const AsyncGenerator&) = delete;
+    AsyncGenerator& operator=(const AsyncGenerator&) = delete;
+    AsyncGenerator(AsyncGenerator&& o) noexcept
+    : m_coroutine(std::exchange(o.m_coroutine, nullptr))
+    {}
+    AsyncGenerator& operator=(AsyncGenerator&& o) noexcept
+    {
+        if(this != &o)
+        {
+            release();
+            m_coroutine = std::exchange(o.m_coroutine, nullptr);
+        }
+        return *this;
+    }
+    ~AsyncGenerator()
+    {
+        release();
+    }
+
+    // Only one next() can be awaited at a time
+    NextAwaiter next()
+    {
+        return NextAwaiter{m_coroutine};
+    }
+    // Values produced but not taken yet, thread safe
+    std::size_t buffered() const
+    {
+        std::lock_guard lock(m_coroutine.promise().mutex);
+        return m_coroutine.promise().items.size();
+    }
+    // Stops the body and resumes once it is parked or finished, the generator can then be destroyed safely
+    CloseAwaiter close()
+    {
+        return CloseAwaiter{m_coroutine};
+    }
+    // Thread safe, a pending next() returns std::nullopt when the body reaches its next co_yield
+    void requestStop()
+    {
+        std::lock_guard lock(m_coroutine.promise().mutex);
+        m_coroutine.promise().stop_requested = true;
+    }
+private:
+    // Not running, nothing but the generator can resume it
+    static bool isSuspended(const promise_type& promise)
+    {
+        return promise.started == false || promise.parked || promise.finished;
+    }
+    void release()
+    {
+        if(!m_coroutine)
+        {
+            return;
+        }
+        promise_type& promise = m_coroutine.promise();
+        std::unique_lock lock(promise.mutex);
+        if(isSuspended(promise))
+        {
+            lock.unlock();
+            std::exchange(m_coroutine, nullptr).destroy();
+            return;
+        }
+        promise.stop_requested = true;
+        promise.detached = true;
+        m_coroutine = nullptr;
+    }
+
+    Handle m_coroutine;
+};
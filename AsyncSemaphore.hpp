@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+/*
+Counting semaphore for coroutines. co_await acquire() suspends the coroutine while no token is available,
+release() hands the token to the oldest waiting coroutine and resumes it on the releasing thread.
+Acquiring and releasing without contention only touches an atomic counter.
+*/
+class AsyncSemaphore
+{
+public:
+    struct [[nodiscard]] Awaiter
+    {
+        AsyncSemaphore* semaphore {nullptr};
+        std::coroutine_handle<> awaiting_coroutine = std::noop_coroutine();
+        Awaiter* next {nullptr};
+        bool await_ready() { return semaphore->tryAcquire(); }
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            awaiting_coroutine = handle;
+            return semaphore->suspendOrAcquire(this);
+        }
+        void await_resume() {}
+    };
+
+    explicit AsyncSemaphore(uint32_t count)
+    : m_count(count)
+    {}
+    AsyncSemaphore(const AsyncSemaphore&) = delete;
+    AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+
+    Awaiter acquire()
+    {
+        return Awaiter{this};
+    }
+    bool tryAcquire()
+    {
+        int64_t count = m_count.load(std::memory_order_relaxed);
+        while(count > 0)
+        {
+            if(m_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    void release()
+    {
+        m_count.fetch_add(1, std::memory_order_release);
+        // Pairs with the fence in suspendOrAcquire, either the awaiter sees the token or we see the awaiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_awaiter_count.load(std::memory_order_relaxed) != 0)
+        {
+            resumeAwaitersLocked(std::unique_lock(m_awaiters_mutex), nullptr);
+        }
+    }
+    uint32_t available() const
+    {
+        const int64_t count = m_count.load(std::memory_order_relaxed);
+        return count > 0 ? static_cast<uint32_t>(count) : 0;
+    }
+private:
+    // Returns false when the awaiter got a token and should not be suspended
+    bool suspendOrAcquire(Awaiter* awaiter)
+    {
+        std::unique_lock lock(m_awaiters_mutex);
+        awaiter->next = nullptr;
+        if(m_awaiters_tail == nullptr)
+        {
+            m_awaiters_head = awaiter;
+        }
+        else
+        {
+            m_awaiters_tail->next = awaiter;
+        }
+        m_awaiters_tail = awaiter;
+        m_awaiter_count.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // A token could have been released between await_ready and the registration above
+        return resumeAwaitersLocked(std::move(lock), awaiter);
+    }
+    /*
+    Hands out the available tokens to the waiting awaiters in FIFO order, the coroutines are resumed outside of the lock.
+    The `current` awaiter is not resumed, returns false instead if it got a token.
+    */
+    bool resumeAwaitersLocked(std::unique_lock<std::mutex> lock, Awaiter* current)
+    {
+        Awaiter* resumable = nullptr;
+        Awaiter** resumable_tail = &resumable;
+        bool current_suspended = true;
+        while(m_awaiters_head != nullptr && tryAcquire())
+        {
+            Awaiter* awaiter = std::exchange(m_awaiters_head, m_awaiters_head->next);
+            m_awaiter_count.fetch_sub(1, std::memory_order_relaxed);
+            awaiter->next = nullptr;
+            if(awaiter == current)
+            {
+                current_suspended = false;
+                continue;
+            }
+            *resumable_tail = awaiter;
+            resumable_tail = &awaiter->next;
+        }
+        if(m_awaiters_head == nullptr)
+        {
+            m_awaiters_tail = nullptr;
+        }
+        lock.unlock();
+        while(resumable != nullptr)
+        {
+            // The awaiter can be destroyed by the resumed coroutine
+            Awaiter* awaiter = std::exchange(resumable, resumable->next);
+            awaiter->awaiting_coroutine.resume();
+        }
+        return current_suspended;
+    }
+
+    std::atomic<int64_t> m_count {0};
+    std::mutex m_awaiters_mutex;
+    Awaiter* m_awaiters_head {nullptr};
+    Awaiter* m_awaiters_tail {nullptr};
+    std::atomic<uint32_t> m_awaiter_count {0};
+};
@@ -1,57 +1,75 @@
 #include "Backend.hpp"
 #include "util.hpp"
 #include "durations.hpp"
-#include "SingleShotEvent.hpp"
 
-#include <optick.h>
+#include <algorithm>
+#include <stdexcept>
 
-void BackendA::colorize()
+#include "Trace.hpp"
+
+void Backend::beginResize()
 {
-    OPTICK_EVENT();
-    busyWait(durations::one_transform);
-};
-void BackendA::resize() 
+    m_resized = Channels(m_channels.width / 2, m_channels.height / 2, m_channels.getPool());
+}
+void Backend::endResize()
 {
-    OPTICK_EVENT();
-    busyWait(durations::one_transform);
+    m_channels = std::move(m_resized);
+    m_resized = Channels{};
 }
-Lazy<Backend::Channels> BackendA::readChannels() const 
+void Backend::copyTile(const Backend& other, uint32_t tile, uint32_t tile_count)
 {
-    OPTICK_EVENT();
-    SingleShotEvent event;
-    std::thread([&]
+    TRACE_EVENT();
+    const Channels& source = other.m_channels;
+    if(source.width != m_channels.width || source.height != m_channels.height)
     {
-        OPTICK_THREAD("Background worker");
-        OPTICK_EVENT();
-        busyWait(durations::one_transform);
-        event.set();
-    }).detach();
-    co_await event;
-    co_return Backend::Channels{};
+        throw std::invalid_argument("Can't copy a tile between images of different size");
+    }
+    const RowRange rows = bandRows(m_channels.height, tile, tile_count);
+    for(uint32_t channel = 0; channel < Channels::Count; ++channel)
+    {
+        for(uint32_t y = rows.begin; y < rows.end; ++y)
+        {
+            std::copy_n(source.row(channel, y), m_channels.width, m_channels.row(channel, y));
+        }
+    }
+}
+
+std::unique_ptr<Backend> BackendA::clone() const
+{
+    TRACE_EVENT();
+    return std::make_unique<BackendA>(*this);
 }
-void BackendA::reconstructFromChannels(const Channels&) 
+Lazy<Backend::Channels> BackendA::readChannels() const 
 {
-    OPTICK_EVENT();
-    busyWait(durations::one_transform);
+    TRACE_ASYNC_EVENT();
+    if(!m_io_scheduler.has_value())
+    {
+        co_return m_channels;
+    }
+    // Only a queue push, the copy runs on one of the I/O threads
+    co_return co_await (stdexec::schedule(*m_io_scheduler) | stdexec::then([this]
+    {
+        TRACE_EVENT("BackendA::readChannels I/O");
+        return m_channels;
+    }));
 }
-void BackendB::colorize() 
+void BackendA::reconstructFromChannels(Channels channels)
 {
-    OPTICK_EVENT();
-    busyWait(durations::one_transform);
-};
-void BackendB::resize() 
+    TRACE_EVENT();
+    m_channels = std::move(channels);
+}
+std::unique_ptr<Backend> BackendB::clone() const
 {
-    OPTICK_EVENT();
-    busyWait(durations::one_transform);
+    TRACE_EVENT();
+    return std::make_unique<BackendB>(*this);
 }
 Lazy<Backend::Channels> BackendB::readChannels() const 
 {
-    OPTICK_EVENT();
-    busyWait(durations::one_transform);
-    co_return Backend::Channels{};
+    TRACE_EVENT();
+    co_return m_channels;
 }
-void BackendB::reconstructFromChannels(const Channels&) 
+void BackendB::reconstructFromChannels(Channels channels)
 {
-    OPTICK_EVENT();
-    busyWait(durations::one_transform);
-}
\ No newline at end of file
+    TRACE_EVENT();
+    m_channels = std::move(channels);
+}
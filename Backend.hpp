@@ -1,51 +1,178 @@
 #pragma once
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <exec/static_thread_pool.hpp>
 #include "Lazy.hpp"
+#include "Channels.hpp"
+#include "BackendKernels.hpp"
+
+#include "Trace.hpp"
+
+enum class BackendKind
+{
+    A,
+    B
+};
+
 class Backend
 {
 public:
+    using Channels = PlanarChannels;
+    // Executes the blocking part of the asynchronous reads
+    using IoScheduler = exec::static_thread_pool::scheduler;
+
     virtual ~Backend() = default;
-    struct Channels
-    {};
 
+    virtual std::unique_ptr<Backend> clone() const = 0;
     virtual Lazy<Channels> readChannels() const = 0;
-    virtual void reconstructFromChannels(const Channels&) = 0;
-    virtual void colorize() = 0;
-    virtual void resize() = 0;
+    virtual void reconstructFromChannels(Channels) = 0;
+    void colorize() { colorizeTile(0, 1); }
+    void resize()
+    {
+        beginResize();
+        resizeTile(0, 1);
+        endResize();
+    }
+    // Processes the tile-th horizontal band out of tile_count, different bands can be processed in parallel
+    virtual void colorizeTile(uint32_t tile, uint32_t tile_count) = 0;
+    // Halves the resolution. The bands write a separate buffer which is prepared by beginResize and takes over the image in endResize.
+    virtual void resizeTile(uint32_t tile, uint32_t tile_count) = 0;
+    void beginResize();
+    void endResize();
+    // Overwrites the tile-th band with the one of `other`, the geometry of the two has to match
+    void copyTile(const Backend& other, uint32_t tile, uint32_t tile_count);
+
+    const Channels& getChannels() const { return m_channels; }
+    Channels& getChannels() { return m_channels; }
+    // Identifies the final class, see visitBackend
+    BackendKind getKind() const { return m_kind; }
+    // Without an I/O scheduler the reads complete synchronously on the calling thread
+    void setIoScheduler(std::optional<IoScheduler> io_scheduler) { m_io_scheduler = std::move(io_scheduler); }
+protected:
+    Backend(BackendKind kind, uint32_t width, uint32_t height)
+    : m_kind(kind)
+    , m_channels(width, height)
+    {}
+    Backend(const Backend& o)
+    : m_kind(o.m_kind)
+    , m_channels(o.m_channels)
+    , m_io_scheduler(o.m_io_scheduler)
+    {}
+
+    const BackendKind m_kind;
+    Channels m_channels;
+    std::optional<IoScheduler> m_io_scheduler;
+    Channels m_resized;
 };
 
 class BackendA : public Backend
 {
 public:
+    static constexpr const BackendKind KIND = BackendKind::A;
+
+    BackendA(uint32_t width, uint32_t height)
+    : Backend(KIND, width, height)
+    {}
     ~BackendA() final = default;
+    std::unique_ptr<Backend> clone() const final;
     Lazy<Channels> readChannels() const final;
-    void reconstructFromChannels(const Channels&) final;
-    void colorize() final;
-    void resize() final;
+    void reconstructFromChannels(Channels) final;
+    void colorizeTile(uint32_t tile, uint32_t tile_count) final
+    {
+        TRACE_EVENT();
+        BackendKernels::colorizeRows(m_channels, bandRows(m_channels.height, tile, tile_count));
+    }
+    void resizeTile(uint32_t tile, uint32_t tile_count) final
+    {
+        TRACE_EVENT();
+        BackendKernels::downscaleRows(m_channels, m_resized, bandRows(m_channels.height, tile, tile_count));
+    }
 };
 class BackendB : public Backend
 {
 public:
+    static constexpr const BackendKind KIND = BackendKind::B;
+
+    BackendB(uint32_t width, uint32_t height)
+    : Backend(KIND, width, height)
+    {}
     ~BackendB() final = default;
+    std::unique_ptr<Backend> clone() const final;
     Lazy<Channels> readChannels() const final;
-    void reconstructFromChannels(const Channels&) final;
-    void colorize() final;
-    void resize() final;
+    void reconstructFromChannels(Channels) final;
+    void colorizeTile(uint32_t tile, uint32_t tile_count) final
+    {
+        TRACE_EVENT();
+        BackendKernels::colorizeRows(m_channels, bandRows(m_channels.height, tile, tile_count));
+    }
+    void resizeTile(uint32_t tile, uint32_t tile_count) final
+    {
+        TRACE_EVENT();
+        BackendKernels::downscaleRows(m_channels, m_resized, bandRows(m_channels.height, tile, tile_count));
+    }
 };
 
+/*
+Defining SANDBOX_STATIC_BACKEND (BackendA or BackendB) fixes the backend at compile time: the factory always creates it
+and visitBackend calls it without any dispatch, so the tile kernels inline into the callers.
+Otherwise the backend is selected at runtime by BackendFactory::use_backend_a.
+*/
+#ifdef SANDBOX_STATIC_BACKEND
+using StaticBackend = SANDBOX_STATIC_BACKEND;
+#endif
+
 class BackendFactory
 {
     public:
     static inline bool use_backend_a {true};
-    static std::unique_ptr<Backend> createBackend() 
+    static std::unique_ptr<Backend> createBackend(uint32_t width = 0, uint32_t height = 0) 
     {
+#ifdef SANDBOX_STATIC_BACKEND
+        return createBackend<StaticBackend>(width, height);
+#else
         if(use_backend_a)
         {
-            return std::make_unique<BackendA>();
+            return createBackend<BackendA>(width, height);
         }
         else
         {
-            return std::make_unique<BackendB>(); 
+            return createBackend<BackendB>(width, height); 
         }
+#endif
+    }
+    private:
+    template<typename BACKEND>
+    static std::unique_ptr<Backend> createBackend(uint32_t width, uint32_t height)
+    {
+        return std::make_unique<BACKEND>(width, height);
     }
 };
+
+// Calls `callback` with the backend cast to its final class, so the calls are not virtual
+template<typename Callback>
+decltype(auto) visitBackend(Backend& backend, Callback&& callback)
+{
+#ifdef SANDBOX_STATIC_BACKEND
+    return callback(static_cast<StaticBackend&>(backend));
+#else
+    if(backend.getKind() == BackendKind::A)
+    {
+        return callback(static_cast<BackendA&>(backend));
+    }
+    return callback(static_cast<BackendB&>(backend));
+#endif
+}
+template<typename Callback>
+decltype(auto) visitBackend(const Backend& backend, Callback&& callback)
+{
+#ifdef SANDBOX_STATIC_BACKEND
+    return callback(static_cast<const StaticBackend&>(backend));
+#else
+    if(backend.getKind() == BackendKind::A)
+    {
+        return callback(static_cast<const BackendA&>(backend));
+    }
+    return callback(static_cast<const BackendB&>(backend));
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "Channels.hpp"
+
+namespace BackendKernels
+{
+    // Sepia tone, every row of a plane is a contiguous aligned array so the loop is vectorized by the compiler
+    inline void colorizeRows(PlanarChannels& channels, RowRange rows)
+    {
+        using Channels = PlanarChannels;
+        for(uint32_t y = rows.begin; y < rows.end; ++y)
+        {
+            float* __restrict red = channels.row(Channels::Red, y);
+            float* __restrict green = channels.row(Channels::Green, y);
+            float* __restrict blue = channels.row(Channels::Blue, y);
+            for(uint32_t x = 0; x < channels.width; ++x)
+            {
+                const float r = red[x];
+                const float g = green[x];
+                const float b = blue[x];
+                red[x] = std::min(1.0f, 0.393f * r + 0.769f * g + 0.189f * b);
+                green[x] = std::min(1.0f, 0.349f * r + 0.686f * g + 0.168f * b);
+                blue[x] = std::min(1.0f, 0.272f * r + 0.534f * g + 0.131f * b);
+            }
+        }
+    }
+    // 2x2 box filter, the source rows [rows.begin, rows.end) produce the target rows [rows.begin / 2, rows.end / 2)
+    inline void downscaleRows(const PlanarChannels& source, PlanarChannels& target, RowRange rows)
+    {
+        using Channels = PlanarChannels;
+        const uint32_t end = std::min(rows.end / 2, target.height);
+        for(uint32_t channel = 0; channel < Channels::Count; ++channel)
+        {
+            for(uint32_t y = rows.begin / 2; y < end; ++y)
+            {
+                const float* __restrict top = source.row(channel, 2 * y);
+                const float* __restrict bottom = source.row(channel, 2 * y + 1);
+                float* __restrict result = target.row(channel, y);
+                for(uint32_t x = 0; x < target.width; ++x)
+                {
+                    result[x] = 0.25f * (top[2 * x] + top[2 * x + 1] + bottom[2 * x] + bottom[2 * x + 1]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,227 @@
+#include "ChannelKernels.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHANNEL_KERNELS_X86 1
+#endif
+
+#include "Trace.hpp"
+
+namespace
+{
+    using namespace ChannelKernels;
+
+    int32_t lutIndex(float value, float last_index)
+    {
+        return static_cast<int32_t>(std::clamp(value, 0.0f, 1.0f) * last_index + 0.5f);
+    }
+
+    void affineScalar(float* data, std::size_t begin, std::size_t end, const Affine& op)
+    {
+        for(std::size_t i = begin; i < end; ++i)
+        {
+            data[i] = data[i] * op.scale + op.offset;
+        }
+    }
+    void clampScalar(float* data, std::size_t begin, std::size_t end, const Clamp& op)
+    {
+        for(std::size_t i = begin; i < end; ++i)
+        {
+            data[i] = std::clamp(data[i], op.min, op.max);
+        }
+    }
+    void lutScalar(float* data, std::size_t begin, std::size_t end, const Lut& op)
+    {
+        const float last_index = static_cast<float>(op.table.size() - 1);
+        for(std::size_t i = begin; i < end; ++i)
+        {
+            data[i] = op.table[lutIndex(data[i], last_index)];
+        }
+    }
+
+#ifdef CHANNEL_KERNELS_X86
+    void affineSSE(float* data, std::size_t size, const Affine& op)
+    {
+        const __m128 scale = _mm_set1_ps(op.scale);
+        const __m128 offset = _mm_set1_ps(op.offset);
+        std::size_t i = 0;
+        for(; i + 4 <= size; i += 4)
+        {
+            _mm_storeu_ps(data + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(data + i), scale), offset));
+        }
+        affineScalar(data, i, size, op);
+    }
+    void clampSSE(float* data, std::size_t size, const Clamp& op)
+    {
+        const __m128 min = _mm_set1_ps(op.min);
+        const __m128 max = _mm_set1_ps(op.max);
+        std::size_t i = 0;
+        for(; i + 4 <= size; i += 4)
+        {
+            _mm_storeu_ps(data + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(data + i), min), max));
+        }
+        clampScalar(data, i, size, op);
+    }
+    // SSE has no gather, only the index computation is vectorized
+    void lutSSE(float* data, std::size_t size, const Lut& op)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 last_index = _mm_set1_ps(static_cast<float>(op.table.size() - 1));
+        const __m128 half = _mm_set1_ps(0.5f);
+        alignas(16) int32_t indices[4];
+        std::size_t i = 0;
+        for(; i + 4 <= size; i += 4)
+        {
+            const __m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(data + i), zero), one);
+            _mm_store_si128(reinterpret_cast<__m128i*>(indices), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, last_index), half)));
+            data[i] = op.table[indices[0]];
+            data[i + 1] = op.table[indices[1]];
+            data[i + 2] = op.table[indices[2]];
+            data[i + 3] = op.table[indices[3]];
+        }
+        lutScalar(data, i, size, op);
+    }
+
+    __attribute__((target("avx2,fma"))) void affineAVX2(float* data, std::size_t size, const Affine& op)
+    {
+        const __m256 scale = _mm256_set1_ps(op.scale);
+        const __m256 offset = _mm256_set1_ps(op.offset);
+        std::size_t i = 0;
+        for(; i + 8 <= size; i += 8)
+        {
+            _mm256_storeu_ps(data + i, _mm256_fmadd_ps(_mm256_loadu_ps(data + i), scale, offset));
+        }
+        affineScalar(data, i, size, op);
+    }
+    __attribute__((target("avx2"))) void clampAVX2(float* data, std::size_t size, const Clamp& op)
+    {
+        const __m256 min = _mm256_set1_ps(op.min);
+        const __m256 max = _mm256_set1_ps(op.max);
+        std::size_t i = 0;
+        for(; i + 8 <= size; i += 8)
+        {
+            _mm256_storeu_ps(data + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(data + i), min), max));
+        }
+        clampScalar(data, i, size, op);
+    }
+    __attribute__((target("avx2,fma"))) void lutAVX2(float* data, std::size_t size, const Lut& op)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 last_index = _mm256_set1_ps(static_cast<float>(op.table.size() - 1));
+        const __m256 half = _mm256_set1_ps(0.5f);
+        std::size_t i = 0;
+        for(; i + 8 <= size; i += 8)
+        {
+            const __m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(data + i), zero), one);
+            const __m256i indices = _mm256_cvttps_epi32(_mm256_fmadd_ps(value, last_index, half));
+            _mm256_storeu_ps(data + i, _mm256_i32gather_ps(op.table.data(), indices, sizeof(float)));
+        }
+        lutScalar(data, i, size, op);
+    }
+#endif
+
+    InstructionSet detectInstructionSet()
+    {
+#ifdef CHANNEL_KERNELS_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return InstructionSet::AVX2;
+        }
+        if(__builtin_cpu_supports("sse2"))
+        {
+            return InstructionSet::SSE;
+        }
+#endif
+        return InstructionSet::Scalar;
+    }
+
+    template<typename Op>
+    using Kernel = void (*)(float*, std::size_t, const Op&);
+
+    template<typename Op, void (*SCALAR)(float*, std::size_t, std::size_t, const Op&)>
+    void scalarKernel(float* data, std::size_t size, const Op& op)
+    {
+        SCALAR(data, 0, size, op);
+    }
+
+    struct Dispatch
+    {
+        Kernel<Affine> affine {scalarKernel<Affine, affineScalar>};
+        Kernel<Clamp> clamp {scalarKernel<Clamp, clampScalar>};
+        Kernel<Lut> lut {scalarKernel<Lut, lutScalar>};
+        InstructionSet instruction_set {InstructionSet::Scalar};
+    };
+
+    Dispatch createDispatch()
+    {
+        Dispatch dispatch;
+        dispatch.instruction_set = detectInstructionSet();
+#ifdef CHANNEL_KERNELS_X86
+        switch(dispatch.instruction_set)
+        {
+            case InstructionSet::AVX2:
+                dispatch.affine = affineAVX2;
+                dispatch.clamp = clampAVX2;
+                dispatch.lut = lutAVX2;
+                break;
+            case InstructionSet::SSE:
+                dispatch.affine = affineSSE;
+                dispatch.clamp = clampSSE;
+                dispatch.lut = lutSSE;
+                break;
+            case InstructionSet::Scalar:
+                break;
+        }
+#endif
+        return dispatch;
+    }
+
+    const Dispatch& getDispatch()
+    {
+        static const Dispatch dispatch = createDispatch();
+        return dispatch;
+    }
+}
+
+namespace ChannelKernels
+{
+    InstructionSet getInstructionSet()
+    {
+        return getDispatch().instruction_set;
+    }
+    const char* toString(InstructionSet instruction_set)
+    {
+        switch(instruction_set)
+        {
+            case InstructionSet::AVX2: return "AVX2";
+            case InstructionSet::SSE: return "SSE";
+            case InstructionSet::Scalar: return "Scalar";
+        }
+        return "Unknown";
+    }
+    void apply(std::span<float> samples, const Affine& op)
+    {
+        TRACE_EVENT();
+        getDispatch().affine(samples.data(), samples.size(), op);
+    }
+    void apply(std::span<float> samples, const Clamp& op)
+    {
+        TRACE_EVENT();
+        getDispatch().clamp(samples.data(), samples.size(), op);
+    }
+    void apply(std::span<float> samples, const Lut& op)
+    {
+        TRACE_EVENT();
+        if(op.table.empty())
+        {
+            throw std::invalid_argument("Lookup table can't be empty");
+        }
+        getDispatch().lut(samples.data(), samples.size(), op);
+    }
+}
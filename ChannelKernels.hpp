@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/*
+Whole-plane sample transforms. The implementation (AVX2, SSE or scalar) is selected once at runtime
+based on the CPU, the planes are processed including the row padding so they are one contiguous loop.
+*/
+namespace ChannelKernels
+{
+    enum class InstructionSet
+    {
+        Scalar,
+        SSE,
+        AVX2
+    };
+    InstructionSet getInstructionSet();
+    const char* toString(InstructionSet instruction_set);
+
+    // value * scale + offset
+    struct Affine
+    {
+        float scale {1.0f};
+        float offset {0.0f};
+    };
+    // std::clamp(value, min, max)
+    struct Clamp
+    {
+        float min {0.0f};
+        float max {1.0f};
+    };
+    // table[round(clamp(value, 0, 1) * (table.size() - 1))]
+    struct Lut
+    {
+        std::span<const float> table;
+    };
+
+    void apply(std::span<float> samples, const Affine& op);
+    void apply(std::span<float> samples, const Clamp& op);
+    void apply(std::span<float> samples, const Lut& op);
+}
@@ -1,24 +1,48 @@
 #pragma once
 #include "Image.hpp"
 #include "Backend.hpp"
-#include <functional>
-#include <iostream>
+#include "ChannelKernels.hpp"
+#include <concepts>
+#include <span>
+#include <utility>
 class ChannelView
 {
     public:
+        using Channel = Backend::Channels::Channel;
+
         static Lazy<ChannelView> asyncCreate(Image image)
         {
             co_return ChannelView{co_await image.readChannels()};
         }
+        explicit ChannelView(Backend::Channels channels)
+         : m_channels(std::move(channels))
+        {}
 
-        void manipulateChannel(std::function<float(float color)> callback) 
+        // Affine, Clamp or Lut over the whole plane with the best instruction set of the CPU
+        template<typename Op>
+            requires requires(std::span<float> samples, const Op& op) { ChannelKernels::apply(samples, op); }
+        void manipulateChannel(Channel channel, const Op& op)
+        {
+            ChannelKernels::apply(getSamples(channel), op);
+        }
+        // Arbitrary per sample transform, inlined into the loop so the compiler can vectorize it
+        template<typename Callback>
+            requires std::regular_invocable<Callback, float>
+        void manipulateChannel(Channel channel, Callback&& callback)
         {
-            std::cout << "Transform from 0.8 to " << callback(0.8f) << std::endl;
+            for(float& sample : getSamples(channel))
+            {
+                sample = callback(sample);
+            }
         }
         const Backend::Channels& getChannels() const { return m_channels; }
+        Backend::Channels takeChannels() && { return std::move(m_channels); }
     private:
-        explicit ChannelView(Backend::Channels channels)
-         : m_channels(std::move(channels))
-        {}
+        // Includes the row padding, it is cheaper to process it than to skip it
+        std::span<float> getSamples(Channel channel)
+        {
+            auto& plane = m_channels.planes[channel];
+            return std::span<float>(plane.data(), plane.size());
+        }
         Backend::Channels m_channels;
-};
\ No newline at end of file
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace AlignedAllocation
+{
+    constexpr const std::size_t ALIGNMENT = 64;
+
+    inline float* allocate(std::size_t size)
+    {
+        return size == 0 ? nullptr : static_cast<float*>(::operator new[](size * sizeof(float), std::align_val_t{ALIGNMENT}));
+    }
+    inline void deallocate(float* data)
+    {
+        ::operator delete[](data, std::align_val_t{ALIGNMENT});
+    }
+}
+
+/*
+Recycles plane buffers by size, so a steady stream of same sized frames doesn't allocate (and page fault)
+fresh memory for every frame. Buffers above max_cached_bytes are released to the system.
+*/
+class PlanePool
+{
+public:
+    static constexpr const std::size_t DEFAULT_MAX_CACHED_BYTES = std::size_t{256} << 20;
+
+    explicit PlanePool(std::size_t max_cached_bytes = DEFAULT_MAX_CACHED_BYTES)
+    : m_max_cached_bytes(max_cached_bytes)
+    {}
+    PlanePool(const PlanePool&) = delete;
+    PlanePool& operator=(const PlanePool&) = delete;
+    ~PlanePool()
+    {
+        for(auto& [size, buffers] : m_free_buffers)
+        {
+            for(float* data : buffers)
+            {
+                AlignedAllocation::deallocate(data);
+            }
+        }
+    }
+
+    float* allocate(std::size_t size)
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            if(auto it = m_free_buffers.find(size); it != m_free_buffers.end() && !it->second.empty())
+            {
+                float* data = it->second.back();
+                it->second.pop_back();
+                m_cached_bytes -= size * sizeof(float);
+                return data;
+            }
+        }
+        return AlignedAllocation::allocate(size);
+    }
+    void recycle(float* data, std::size_t size)
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            if(m_cached_bytes + size * sizeof(float) <= m_max_cached_bytes)
+            {
+                m_free_buffers[size].push_back(data);
+                m_cached_bytes += size * sizeof(float);
+                return;
+            }
+        }
+        AlignedAllocation::deallocate(data);
+    }
+    std::size_t cachedBytes() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_cached_bytes;
+    }
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::size_t, std::vector<float*>> m_free_buffers;
+    std::size_t m_cached_bytes {0};
+    const std::size_t m_max_cached_bytes;
+};
+
+// Float samples of one channel, allocated on a cache line boundary. Goes back to its pool (if any) when destroyed.
+class AlignedPlane
+{
+public:
+    static constexpr const std::size_t ALIGNMENT = AlignedAllocation::ALIGNMENT;
+
+    AlignedPlane() = default;
+    explicit AlignedPlane(std::size_t size, const std::shared_ptr<PlanePool>& pool = nullptr)
+    : m_data(pool != nullptr ? pool->allocate(size) : AlignedAllocation::allocate(size), Deleter{pool, size, nullptr})
+    , m_size(size)
+    {}
+    /*
+    Aliases `size` samples owned by somebody else (e.g. a memory mapped file), `owner` is kept alive as long as the plane.
+    Copies of the plane are regular allocations.
+    */
+    AlignedPlane(float* data, std::size_t size, std::shared_ptr<const void> owner)
+    : m_data(data, Deleter{nullptr, size, std::move(owner)})
+    , m_size(size)
+    {}
+    AlignedPlane(const AlignedPlane& o)
+    : AlignedPlane(o.m_size, o.getPool())
+    {
+        std::copy_n(o.data(), m_size, data());
+    }
+    AlignedPlane& operator=(const AlignedPlane& o)
+    {
+        if(this != &o)
+        {
+            *this = AlignedPlane(o);
+        }
+        return *this;
+    }
+    AlignedPlane(AlignedPlane&&) = default;
+    AlignedPlane& operator=(AlignedPlane&&) = default;
+
+    float* data() { return m_data.get(); }
+    const float* data() const { return m_data.get(); }
+    std::size_t size() const { return m_size; }
+    const std::shared_ptr<PlanePool>& getPool() const { return m_data.get_deleter().pool; }
+private:
+    struct Deleter
+    {
+        std::shared_ptr<PlanePool> pool;
+        std::size_t size;
+        std::shared_ptr<const void> owner;
+        void operator()(float* data) const
+        {
+            if(owner != nullptr)
+            {
+                return;
+            }
+            if(pool != nullptr)
+            {
+                pool->recycle(data, size);
+            }
+            else
+            {
+                AlignedAllocation::deallocate(data);
+            }
+        }
+    };
+    std::unique_ptr<float[], Deleter> m_data;
+    std::size_t m_size {0};
+};
+
+/*
+Structure of arrays image storage: one plane per channel, every row starts on a cache line
+so a row of a channel can be processed with aligned vector loads.
+*/
+struct PlanarChannels
+{
+    enum Channel : uint32_t
+    {
+        Red,
+        Green,
+        Blue,
+        Alpha,
+        Count
+    };
+    static constexpr const uint32_t ROW_ALIGNMENT = AlignedPlane::ALIGNMENT / sizeof(float);
+
+    PlanarChannels() = default;
+    PlanarChannels(uint32_t width, uint32_t height, const std::shared_ptr<PlanePool>& pool = nullptr)
+    : width(width)
+    , height(height)
+    , stride((width + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT)
+    {
+        for(AlignedPlane& plane : planes)
+        {
+            plane = AlignedPlane(std::size_t{stride} * height, pool);
+        }
+    }
+
+    float* row(uint32_t channel, uint32_t y) { return planes[channel].data() + std::size_t{stride} * y; }
+    const float* row(uint32_t channel, uint32_t y) const { return planes[channel].data() + std::size_t{stride} * y; }
+    bool empty() const { return width == 0 || height == 0; }
+    std::size_t byteSize() const { return std::size_t{stride} * height * Count * sizeof(float); }
+    const std::shared_ptr<PlanePool>& getPool() const { return planes[Red].getPool(); }
+
+    uint32_t width {0};
+    uint32_t height {0};
+    // Samples between the start of two consecutive rows
+    uint32_t stride {0};
+    std::array<AlignedPlane, Count> planes;
+};
+
+struct RowRange
+{
+    uint32_t begin {0};
+    uint32_t end {0};
+};
+
+/*
+Rows of the tile-th horizontal band out of tile_count. Bands are made of row pairs, so the rows
+[begin / 2, end / 2) of a half sized image are computed from this band only (see Backend::resizeTile).
+*/
+inline RowRange bandRows(uint32_t height, uint32_t tile, uint32_t tile_count)
+{
+    const uint64_t pairs = height / 2;
+    const uint32_t begin = static_cast<uint32_t>(2 * (pairs * tile / tile_count));
+    const uint32_t end = tile + 1 == tile_count ? height : static_cast<uint32_t>(2 * (pairs * (tile + 1) / tile_count));
+    return RowRange{begin, end};
+}
@@ -0,0 +1,226 @@
+#include "ChromeTrace.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ChromeTrace
+{
+    namespace
+    {
+        struct ThreadBuffer
+        {
+            uint32_t id {0};
+            std::string name;
+            // Allocated by the first event the thread records, a thread which never traces during a capture costs no ring
+            std::unique_ptr<Event[]> events;
+            // Only the owner thread writes, save() reads the events below it after the capture stopped
+            std::atomic<uint64_t> written {0};
+            // Set by the owner around a record(), start() and save() wait until it is clear
+            std::atomic<bool> recording {false};
+            std::atomic<bool> exited {false};
+        };
+        // Marks the buffer when its thread exits, so start() can free it
+        struct ThreadBufferOwner
+        {
+            std::shared_ptr<ThreadBuffer> buffer;
+            ~ThreadBufferOwner() { buffer->exited.store(true, std::memory_order_release); }
+        };
+
+        std::atomic<bool> g_capturing {false};
+        std::atomic<int64_t> g_start_ns {0};
+        std::mutex g_threads_mutex;
+        // Kept after the threads exit until the next start(), their events are saved too
+        std::vector<std::shared_ptr<ThreadBuffer>> g_threads;
+        // Guarded by g_threads_mutex, not reused: the buffers of exited threads are removed
+        uint32_t g_next_thread_id {1};
+
+        ThreadBuffer& threadBuffer()
+        {
+            thread_local ThreadBufferOwner owner {[]
+            {
+                auto new_buffer = std::make_shared<ThreadBuffer>();
+                std::lock_guard lock(g_threads_mutex);
+                new_buffer->id = g_next_thread_id++;
+                g_threads.push_back(new_buffer);
+                return new_buffer;
+            }()};
+            return *owner.buffer;
+        }
+        /*
+        Stops the capture and waits for the records in progress. A record() clears `recording` once done, one which
+        sets it after the wait sees g_capturing cleared (both are sequentially consistent) and writes nothing.
+        */
+        void quiesceLocked()
+        {
+            g_capturing.store(false);
+            for(const std::shared_ptr<ThreadBuffer>& buffer : g_threads)
+            {
+                while(buffer->recording.load())
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        // Microseconds with nanosecond precision
+        void writeMicroseconds(std::ostream& out, int64_t ns)
+        {
+            if(ns < 0)
+            {
+                out << '-';
+                ns = -ns;
+            }
+            out << ns / 1000 << '.' << std::setw(3) << std::setfill('0') << ns % 1000 << std::setfill(' ');
+        }
+        void writeEscaped(std::ostream& out, const char* text)
+        {
+            for(; *text != '\0'; ++text)
+            {
+                if(*text == '"' || *text == '\\')
+                {
+                    out << '\\';
+                }
+                if(static_cast<unsigned char>(*text) >= 0x20)
+                {
+                    out << *text;
+                }
+            }
+        }
+    }
+
+    bool isCapturing()
+    {
+        return g_capturing.load(std::memory_order_relaxed);
+    }
+    int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    uint32_t threadId()
+    {
+        return threadBuffer().id;
+    }
+    void record(const Event& event)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        buffer.recording.store(true);
+        if(g_capturing.load())
+        {
+            if(buffer.events == nullptr)
+            {
+                buffer.events = std::make_unique<Event[]>(EVENTS_PER_THREAD);
+            }
+            const uint64_t written = buffer.written.load(std::memory_order_relaxed);
+            buffer.events[written % EVENTS_PER_THREAD] = event;
+            buffer.written.store(written + 1, std::memory_order_release);
+        }
+        buffer.recording.store(false, std::memory_order_release);
+    }
+    void start()
+    {
+        {
+            std::lock_guard lock(g_threads_mutex);
+            quiesceLocked();
+            // Their events belong to the previous capture, which is dropped
+            std::erase_if(g_threads, [](const std::shared_ptr<ThreadBuffer>& buffer) { return buffer->exited.load(std::memory_order_acquire); });
+            for(const std::shared_ptr<ThreadBuffer>& buffer : g_threads)
+            {
+                buffer->written.store(0, std::memory_order_relaxed);
+            }
+        }
+        g_start_ns.store(now(), std::memory_order_relaxed);
+        g_capturing.store(true);
+    }
+    void stop()
+    {
+        g_capturing.store(false);
+    }
+    bool save(const std::string& path)
+    {
+        std::lock_guard lock(g_threads_mutex);
+        quiesceLocked();
+        std::ofstream out(path);
+        if(!out)
+        {
+            return false;
+        }
+        const int64_t start_ns = g_start_ns.load(std::memory_order_relaxed);
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        // Pairs the begin and the end of the async events
+        uint64_t async_id = 0;
+        for(const std::shared_ptr<ThreadBuffer>& buffer : g_threads)
+        {
+            if(buffer->name.empty() == false)
+            {
+                out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":\"";
+                writeEscaped(out, buffer->name.c_str());
+                out << "\"}}";
+                first = false;
+            }
+            const uint64_t written = buffer->written.load(std::memory_order_acquire);
+            const uint64_t begin = written > EVENTS_PER_THREAD ? written - EVENTS_PER_THREAD : 0;
+            for(uint64_t i = begin; i < written; ++i)
+            {
+                const Event& event = buffer->events[i % EVENTS_PER_THREAD];
+                out << (first ? "" : ",") << "\n{\"ph\":\"" << (event.async ? 'b' : 'X') << "\",\"name\":\"";
+                writeEscaped(out, event.name);
+                out << "\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":";
+                writeMicroseconds(out, event.begin_ns - start_ns);
+                if(event.async)
+                {
+                    out << ",\"cat\":\"async\",\"id\":" << ++async_id;
+                }
+                else
+                {
+                    out << ",\"dur\":";
+                    writeMicroseconds(out, event.duration_ns);
+                }
+                if(event.tag_count != 0)
+                {
+                    out << ",\"args\":{";
+                    for(uint32_t tag = 0; tag < event.tag_count; ++tag)
+                    {
+                        out << (tag == 0 ? "\"" : ",\"") << event.tags[tag].key << "\":";
+                        if(event.tags[tag].quoted)
+                        {
+                            out << '"';
+                            writeEscaped(out, event.tags[tag].value);
+                            out << '"';
+                        }
+                        else
+                        {
+                            out << event.tags[tag].value;
+                        }
+                    }
+                    out << '}';
+                }
+                out << '}';
+                if(event.async)
+                {
+                    out << ",\n{\"ph\":\"e\",\"name\":\"";
+                    writeEscaped(out, event.name);
+                    out << "\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":";
+                    writeMicroseconds(out, event.begin_ns - start_ns + event.duration_ns);
+                    out << ",\"cat\":\"async\",\"id\":" << async_id << '}';
+                }
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+    void setThreadName(const char* name)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        // Called for every frame by some loops, only the first name is stored
+        if(buffer.name.empty())
+        {
+            std::lock_guard lock(g_threads_mutex);
+            buffer.name = name;
+        }
+    }
+}
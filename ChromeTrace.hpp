@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+/*
+Tracing backend writing the Chrome trace event format (chrome://tracing, ui.perfetto.dev), see Trace.hpp.
+Every thread records its events into its own ring buffer without locking, only the last EVENTS_PER_THREAD
+events of a thread are kept so the memory and the overhead stay bounded while tracing in production. The ring of a
+thread is allocated by its first event while capturing, the buffers of the exited threads are freed by the next start().
+The names and the tag keys have to be string literals, the tag values are copied.
+A Scope is a complete ("X") event, which Chrome requires to nest on its thread: it must not live across a co_await,
+other tasks could open and close events on the thread meanwhile. Coroutines use an async Scope instead
+(TRACE_ASYNC_EVENT), saved as a "b"/"e" pair which can overlap anything. A Scope which ends on another thread than
+the one it began on is saved as an async one too.
+*/
+namespace ChromeTrace
+{
+    static constexpr const uint32_t EVENTS_PER_THREAD = 8192;
+    static constexpr const uint32_t MAX_TAGS = 2;
+    static constexpr const uint32_t TAG_VALUE_SIZE = 24;
+
+    struct Tag
+    {
+        const char* key {nullptr};
+        char value[TAG_VALUE_SIZE] {};
+        bool quoted {false};
+    };
+    struct Event
+    {
+        const char* name {nullptr};
+        int64_t begin_ns {0};
+        int64_t duration_ns {0};
+        std::array<Tag, MAX_TAGS> tags {};
+        uint32_t tag_count {0};
+        bool async {false};
+    };
+
+    bool isCapturing();
+    int64_t now();
+    // Id of the calling thread's buffer
+    uint32_t threadId();
+    // Dropped unless capturing
+    void record(const Event& event);
+
+    // The events of the previous capture are dropped, waits for the threads which are recording one
+    void start();
+    // The events which end afterwards are dropped
+    void stop();
+    // Stops the capture if needed and writes the captured events as JSON
+    bool save(const std::string& path);
+    void setThreadName(const char* name);
+
+    inline const char* eventName(const char* function, const char* name = nullptr)
+    {
+        return name != nullptr ? name : function;
+    }
+
+    // Records an event from its construction to its destruction, only an async one can live across a co_await
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name, bool async = false)
+        {
+            if(isCapturing())
+            {
+                m_event.name = name;
+                m_event.async = async;
+                m_thread = threadId();
+                m_event.begin_ns = now();
+                m_active = true;
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope()
+        {
+            if(m_active)
+            {
+                m_event.duration_ns = now() - m_event.begin_ns;
+                m_event.async = m_event.async || threadId() != m_thread;
+                record(m_event);
+            }
+        }
+        template<typename T>
+        void tag(const char* key, const T& value)
+        {
+            if(!m_active || m_event.tag_count == MAX_TAGS)
+            {
+                return;
+            }
+            Tag& tag = m_event.tags[m_event.tag_count++];
+            tag.key = key;
+            if constexpr(std::is_arithmetic_v<T>)
+            {
+                std::to_chars(tag.value, tag.value + TAG_VALUE_SIZE - 1, value);
+            }
+            else
+            {
+                const char* text = value;
+                std::strncpy(tag.value, text != nullptr ? text : "", TAG_VALUE_SIZE - 1);
+                tag.quoted = true;
+            }
+        }
+    private:
+        Event m_event;
+        uint32_t m_thread {0};
+        bool m_active {false};
+    };
+}
@@ -1,13 +1,17 @@
 #pragma once
 
-#include <optick.h>
+#include "Trace.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <thread>
 #include <shared_mutex>
 #include <list>
 #include <condition_variable>
+#include <coroutine>
+#include <stop_token>
+#include <utility>
 
 #include <stdexec/execution.hpp>
 #include <exec/task.hpp>
@@ -25,143 +29,646 @@
 #include "ChannelView.hpp"
 
 #include "QueueScheduler.hpp"
-#include "AsyncReader.hpp"
+#include "AsyncGenerator.hpp"
+#include "AsyncSemaphore.hpp"
+#include "DeadlineTimer.hpp"
+#include "FramePool.hpp"
+#include "StreamAffinityPool.hpp"
+#include "JobResult.hpp"
+#include "JobAdmission.hpp"
+#include "Metrics.hpp"
 
 template<typename THREAD_POOL>
 class Context
 {
 public:
+    // Consecutive ready frames are written together, a batch is flushed as soon as one of the limits is reached
+    struct WriteCoalescing
+    {
+        uint32_t max_frames {FrameWriter::MAX_BATCH};
+        std::size_t max_bytes {64u << 20};
+        // How long a batch which isn't full waits for the next frame, zero writes what is ready
+        std::chrono::microseconds max_latency {0};
+    };
+    struct StreamOptions
+    {
+        // Unordered lets several writers pop frames in completion order (only if the output container allows it)
+        QueueOrder write_order {QueueOrder::Strict};
+        uint32_t writer_count {1};
+        // The reader is suspended while this many frames are transformed or waiting to be written
+        uint32_t max_in_flight {8};
+        /*
+        Colorizes the upper and lower half of a frame in parallel (when_all), merges them and resizes the frame.
+        Each stage splits its half/frame into bands (bulk), so a single stream can use more than one worker per frame.
+        */
+        bool fork_join {false};
+        uint32_t tiles_per_half {1};
+        WriteCoalescing coalescing {};
+        // Priority of the write stages on a StreamAffinityPool, the transforms are always bulk
+        StreamPriority write_priority {StreamPriority::Bulk};
+        // Order of the pending jobs when the concurrent job limit is reached
+        JobPriority job_priority {JobPriority::Normal};
+    };
+
+    // Returned by spawn2. Stopping the job reads no more frames, the queued ones skip the stages and aren't written.
+    class JobHandle
+    {
+    public:
+        JobHandle() = default;
+        explicit JobHandle(std::stop_source stop_source)
+        : m_stop_source(std::move(stop_source))
+        {}
+        // Thread safe, the completion callback still gets the result once the dropped frames are released
+        void requestStop() { m_stop_source.request_stop(); }
+        bool stopRequested() const { return m_stop_source.stop_requested(); }
+    private:
+        std::stop_source m_stop_source {std::nostopstate};
+    };
+
     template <class... Args>
       requires stdexec::constructible_from<THREAD_POOL, Args...>
     Context(Args&&... args)
         : m_pool(std::forward<Args>(args)...)
     {
+        m_pipeline.metrics = &m_metrics;
         if(const uint32_t num_of_threads = m_pool.available_parallelism(); num_of_threads < 32)
         {
             std::cout << "WARNING it looks like not all the threads are utilized (32). If using libuv do not forget defining: UV_THREADPOOL_SIZE to 32.Current num of threads: " 
                     << m_pool.available_parallelism() << std::endl;
         }
     }
+    // `callback` is called with the JobResult of the job when it completed (a callback without parameters is accepted too)
     template<typename T> 
-    void spawn2(Input input, Output output, T&& callback)
+    JobHandle spawn2(Input input, Output output, T&& callback, StreamOptions options = {})
     {
-        OPTICK_EVENT();
+        TRACE_EVENT();
         using stdexec::then;
-        stdexec::sender auto task_flow = processVideoPerFrame(std::move(input), std::move(output)) | then(callback);
+        if(options.writer_count == 0 || (options.write_order == QueueOrder::Strict && options.writer_count > 1))
+        {
+            throw std::invalid_argument("Strict frame order needs exactly one writer");
+        }
+        if(options.max_in_flight == 0)
+        {
+            throw std::invalid_argument("At least one frame has to be in flight");
+        }
+        if(options.tiles_per_half == 0)
+        {
+            throw std::invalid_argument("A half frame has to be processed in at least one tile");
+        }
+        if(options.coalescing.max_frames == 0)
+        {
+            throw std::invalid_argument("A write has to contain at least one frame");
+        }
+        input.setFramePool(m_frame_pool);
+        auto complete = [callback = std::forward<T>(callback)](JobResult result) mutable
+        {
+            if constexpr(std::is_invocable_v<decltype(callback)&, JobResult>)
+            {
+                callback(std::move(result));
+            }
+            else
+            {
+                callback();
+            }
+        };
+        FrameJob job;
+        JobHandle handle{job.stop_source};
+        stdexec::sender auto task_flow = runJob(std::move(input), std::move(output), options, std::move(job)) | then(std::move(complete));
         m_scope.spawn(std::move(task_flow));
+        return handle;
     }
     ~Context()
     {
         waitForAll();
+        // The pool may outlive the context (an input keeps it), its backends must not read on the I/O threads
+        m_frame_pool->detachIoScheduler();
     }
     void waitForAll()
     {
         stdexec::sync_wait(m_scope.on_empty());
     }
+    FramePool& getFramePool() { return *m_frame_pool; }
+    /*
+    Caps the frames in flight across all the streams, 0 means no limit. Can be changed only while no stream runs,
+    a stream keeps the limit it started with.
+    */
+    void setGlobalMaxFramesInFlight(uint32_t max_frames)
+    {
+        std::lock_guard lock(m_streams_mutex);
+        if(std::ranges::any_of(m_streams, [](const std::weak_ptr<Stream>& weak_stream) { return !weak_stream.expired(); }))
+        {
+            throw std::runtime_error("Frame limit can't be changed while streams are running");
+        }
+        m_global_window = max_frames == 0 ? nullptr : std::make_shared<AsyncSemaphore>(max_frames);
+    }
+    /*
+    At most `max_jobs` jobs run at once, 0 means no limit. The other jobs wait in spawn2's order within their
+    JobPriority. With a limit, every admitted job gets an equal share of the workers: its frames in flight are capped
+    to available_parallelism() / max_jobs.
+    */
+    void setMaxConcurrentJobs(uint32_t max_jobs)
+    {
+        m_admission.setMaxRunning(max_jobs);
+    }
+    uint32_t runningJobs() const { return m_admission.running(); }
+    uint32_t pendingJobs() const { return m_admission.pending(); }
+
+    // Always collected, cheap enough to be called periodically
+    MetricsSnapshot metricsSnapshot()
+    {
+        MetricsSnapshot snapshot;
+        for(uint32_t i = 0; i < snapshot.stages.size(); ++i)
+        {
+            snapshot.stages[i] = m_metrics.stage(static_cast<MetricStage>(i)).snapshot();
+        }
+        {
+            std::lock_guard lock(m_streams_mutex);
+            std::erase_if(m_streams, [](const std::weak_ptr<Stream>& stream) { return stream.expired(); });
+            for(const std::weak_ptr<Stream>& weak_stream : m_streams)
+            {
+                if(std::shared_ptr<Stream> stream = weak_stream.lock())
+                {
+                    ++snapshot.streams;
+                    snapshot.queued_frames += stream->queue.size();
+                    snapshot.read_ahead_frames += stream->read_ahead_frames.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        snapshot.running_jobs = m_admission.running();
+        snapshot.pending_jobs = m_admission.pending();
+        if constexpr(requires(const THREAD_POOL& pool) { pool.idleTime(); })
+        {
+            snapshot.pool_idle_time = m_pool.idleTime();
+        }
+        return snapshot;
+    }
+    // Writes a snapshot every `interval` until stopped or the context is destroyed
+    void startMetricsDump(std::chrono::milliseconds interval, MetricsFormat format = MetricsFormat::Text, std::ostream& out = std::cout)
+    {
+        m_metrics_dumper = std::make_unique<MetricsDumper>(interval, [this] { return metricsSnapshot(); }, format, out);
+    }
+    void stopMetricsDump()
+    {
+        m_metrics_dumper.reset();
+    }
 private:
+    static constexpr const uint32_t READ_AHEAD_DEPTH = 4;
+    static constexpr const uint32_t IO_THREAD_COUNT = 2;
+
+    // What the stages of a frame need from their job, the copies share the stop state and the metrics
+    struct FrameJob
+    {
+        std::stop_source stop_source;
+        std::shared_ptr<JobMetrics> metrics {std::make_shared<JobMetrics>()};
+
+        bool stopped() const { return stop_source.stop_requested(); }
+        // Keeps the first error and stops the rest of the job
+        void fail(std::exception_ptr error) const
+        {
+            metrics->setError(std::move(error));
+            std::stop_source(stop_source).request_stop();
+        }
+        /*
+        Runs a synchronous stage of a frame unless the job was stopped, a throwing stage fails the job.
+        Every stage runs on a worker of the pool, whatever pool it is, so it is the place which forbids blocking on a Lazy.
+        */
+        template<typename Stage>
+        void runStage(JobStage job_stage, Stage&& stage) const
+        {
+            if(stopped())
+            {
+                return;
+            }
+            try
+            {
+                WorkerThreadScope worker_scope;
+                JobMetrics::StageTimer timer(metrics.get(), job_stage);
+                stage();
+            }
+            catch(...)
+            {
+                fail(std::current_exception());
+            }
+        }
+    };
 
     struct Pipeline
     {
         bool colorize_enabled {true};
         bool resize_enabled {true};
-        stdexec::sender auto scheduleOn(stdexec::scheduler auto scheduler, Image image)
+        Transform transform;
+        PipelineMetrics* metrics {nullptr};
+
+        LatencyHistogram* histogram(MetricStage metric_stage) const
+        {
+            return metrics != nullptr ? &metrics->stage(metric_stage) : nullptr;
+        }
+        // A stopped job's frames skip the remaining stages, the writers drop them
+        stdexec::sender auto scheduleOn(stdexec::scheduler auto scheduler, Image image, FrameJob job)
+        {
+            using stdexec::just;
+            using stdexec::then;
+            using stdexec::let_value;
+            return stdexec::on(scheduler, just(std::move(image))) 
+            | then([this, job](Image image) { job.runStage(JobStage::Transform, [&] { colorize(image); }); return image; })
+            | then([this, job](Image image) { job.runStage(JobStage::Transform, [&] { resize(image); }); return image; })
+            | let_value([this, scheduler, job](Image& image) { return manipulateAlpha(std::move(image), scheduler, job); });
+        }
+        stdexec::sender auto scheduleForkJoinOn(stdexec::scheduler auto scheduler, Image image, uint32_t tiles_per_half, FrameJob job)
         {
             using stdexec::just;
             using stdexec::then;
+            using stdexec::bulk;
+            using stdexec::when_all;
             using stdexec::let_value;
-            return stdexec::on(scheduler, just(image)) 
-            | then([this](Image image) { return colorize(image); })
-            | then([this](Image image) { return resize(image); })
-            | let_value([this](Image image) { return manipulateAlpha(image); });
+            // Split once on the pool: the upper half keeps the frame, detached so no other image shares it, and the
+            // lower half gets the only deep copy. Neither calls detach() concurrently with its own tiles.
+            auto halves = stdexec::on(scheduler, just(std::move(image)))
+            | then([](Image upper)
+                    {
+                        upper.detach();
+                        Image lower = upper;
+                        lower.detach();
+                        return std::pair{std::move(upper), std::move(lower)};
+                    });
+            auto fork = [this, scheduler, tiles_per_half, job](std::pair<Image, Image>& halves)
+            {
+                auto upper = stdexec::on(scheduler, just(std::move(halves.first)))
+                | bulk(tiles_per_half, [this, tiles_per_half, job](uint32_t tile, Image& image)
+                        {
+                            job.runStage(JobStage::Transform, [&]
+                                         {
+                                             LatencyHistogram::Timer latency_timer(histogram(MetricStage::Colorize));
+                                             transform.transform_upper(image, tile, tiles_per_half);
+                                         });
+                        });
+                auto lower = stdexec::on(scheduler, just(std::move(halves.second)))
+                | bulk(tiles_per_half, [this, tiles_per_half, job](uint32_t tile, Image& image)
+                        {
+                            job.runStage(JobStage::Transform, [&]
+                                         {
+                                             LatencyHistogram::Timer latency_timer(histogram(MetricStage::Colorize));
+                                             transform.transform_lower(image, tile, tiles_per_half);
+                                         });
+                        });
+                return when_all(std::move(upper), std::move(lower));
+            };
+            const uint32_t tile_count = 2 * tiles_per_half;
+            return std::move(halves)
+            | let_value(std::move(fork))
+            | then([this](Image upper, Image lower) { return transform.combine(std::move(upper), std::move(lower)); })
+            | then([](Image image) { image.beginResize(); return image; })
+            | bulk(tile_count, [this, tile_count, job](uint32_t tile, Image& image)
+                    {
+                        job.runStage(JobStage::Transform, [&]
+                                     {
+                                         LatencyHistogram::Timer latency_timer(histogram(MetricStage::Resize));
+                                         image.resizeTile(tile, tile_count);
+                                     });
+                    })
+            | then([](Image image) { image.endResize(); return image; })
+            | let_value([this, scheduler, job](Image& image) { return manipulateAlpha(std::move(image), scheduler, job); });
         }
-        Image colorize(Image image)
+        void colorize(Image& image)
         {
+            LatencyHistogram::Timer latency_timer(histogram(MetricStage::Colorize));
             if(colorize_enabled)
             {
                 image.colorize();
             }
-            return image;
         }
-        Image resize(Image image)
+        void resize(Image& image)
         {
+            LatencyHistogram::Timer latency_timer(histogram(MetricStage::Resize));
             if(resize_enabled)
             {
                 image.resize();
             }
-            return image;
         }
-        exec::task<Image> manipulateAlpha(Image image)
+        // The read of the channels completes on an I/O thread, the kernels run on the pool once the stage is back on it
+        exec::task<Image> manipulateAlpha(Image image, stdexec::scheduler auto scheduler, FrameJob job)
         {
-            co_await image.changeColor(0.2f);
+            if(job.stopped() == false)
+            {
+                try
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    Backend::Channels channels = co_await image.readChannels().continueOn(scheduler);
+                    // Only the wall time of the read, the stage waits for the I/O pool
+                    job.metrics->addTime(JobStage::Transform, std::chrono::steady_clock::now() - start);
+                    job.runStage(JobStage::Transform, [&] { image.changeColor(std::move(channels), 0.2f); });
+                    if(LatencyHistogram* latency = histogram(MetricStage::ManipulateAlpha))
+                    {
+                        latency->record(std::chrono::steady_clock::now() - start);
+                    }
+                }
+                catch(...)
+                {
+                    job.fail(std::current_exception());
+                }
+            }
             co_return image;
         }
-        Image manipulateAlphaBlocking(Image image)
-        {
-            *image.changeColor(0.2f);
-            return image;
-        }
     };
-    stdexec::sender auto readImage(Input* input)
+    stdexec::sender auto transform(Image image, FrameJob job)
     {
-        OPTICK_EVENT();
+        TRACE_EVENT();
         using stdexec::just;
         using stdexec::then;
         auto scheduler = m_pool.get_scheduler();
 
-        return stdexec::on(scheduler, just(input)) | then([](Input* input) { OPTICK_THREAD(g_thread_name.c_str()); return input->read(); });
+        return m_pipeline.scheduleOn(scheduler, std::move(image), std::move(job));
+
     }
-    stdexec::sender auto transform(Image image)
+    stdexec::sender auto transformForkJoin(Image image, uint32_t tiles_per_half, FrameJob job)
     {
-        OPTICK_EVENT();
-        using stdexec::just;
-        using stdexec::then;
+        TRACE_EVENT();
         auto scheduler = m_pool.get_scheduler();
 
-        return m_pipeline.scheduleOn(scheduler, image);
+        return m_pipeline.scheduleForkJoinOn(scheduler, std::move(image), tiles_per_half, std::move(job));
+    }
 
+    struct Stream
+    {
+        explicit Stream(exec::async_scope* scope, const StreamOptions& options, uint32_t preferred_worker, FrameJob job)
+        : queue(scope, options.write_order, options.max_in_flight)
+        , window(options.max_in_flight)
+        , preferred_worker(preferred_worker)
+        , write_priority(options.write_priority)
+        , job(std::move(job))
+        {}
+        QueueScheduler<std::optional<Image>> queue;
+        AsyncSemaphore window;
+        // The stages of the stream are enqueued with this hint (see StreamAffinity)
+        uint32_t preferred_worker {StreamAffinity::ANY_WORKER};
+        StreamPriority write_priority {StreamPriority::Bulk};
+        FrameJob job;
+        // The global limit when the stream started, every frame slot is released into the semaphore it came from
+        std::shared_ptr<AsyncSemaphore> global_window;
+        // Frames read ahead by the input, for the metrics
+        std::atomic<uint32_t> read_ahead_frames {0};
+    };
+
+    exec::task<JobResult> runJob(Input input, Output output, StreamOptions options, FrameJob job)
+    {
+        if(co_await m_admission.admit(options.job_priority, job.stop_source.get_token()) == false)
+        {
+            // Stopped while it was pending, it left the queue without waiting for a slot. Resumed by requestStop(),
+            // the completion callback runs on the pool rather than on the caller's thread.
+            co_await stdexec::schedule(m_pool.get_scheduler());
+            co_return job.metrics->result(true);
+        }
+        const JobAdmission::AdmittedJob admitted(m_admission);
+        if(job.stopped())
+        {
+            // Stopped as it was admitted, nothing was read
+            co_return job.metrics->result(true);
+        }
+        if(const uint32_t max_jobs = m_admission.getMaxRunning(); max_jobs != 0)
+        {
+            const uint32_t fair_share = std::max(m_pool.available_parallelism() / max_jobs, 1u);
+            options.max_in_flight = std::min(options.max_in_flight, fair_share);
+        }
+        co_return co_await processVideoPerFrame(std::move(input), std::move(output), options, std::move(job));
+    }
+    stdexec::sender auto processVideoPerFrame(Input input, Output output, StreamOptions options, FrameJob job)
+    {
+        const uint32_t preferred_worker = m_next_stream_worker++ % std::max(m_pool.available_parallelism(), 1u);
+        auto stream = std::make_shared<Stream>(&m_scope, options, preferred_worker, std::move(job));
+        {
+            std::lock_guard lock(m_streams_mutex);
+            // Also pruned here, so the list doesn't grow when no snapshot is ever taken
+            std::erase_if(m_streams, [](const std::weak_ptr<Stream>& weak_stream) { return weak_stream.expired(); });
+            stream->global_window = m_global_window;
+            m_streams.push_back(stream);
+        }
+        return stdexec::when_all(readImages(std::move(input), stream, options),
+                                 writeImages(std::make_shared<Output>(std::move(output)), stream, options))
+               | stdexec::then([stream] { return stream->job.metrics->result(stream->job.stopped()); });
     }
 
-    stdexec::sender auto processVideoPerFrame(Input input, Output output)
+    exec::task<void> acquireFrameSlot(Stream& stream)
+    {
+        co_await stream.window.acquire();
+        if(stream.global_window != nullptr)
+        {
+            co_await stream.global_window->acquire();
+        }
+    }
+    void releaseFrameSlot(Stream& stream)
     {
-        auto queue = std::make_shared<QueueScheduler<std::optional<Image>>>(&m_scope);
-        return stdexec::when_all(readImages(std::move(input), queue), writeImages(std::move(output), queue));
+        if(stream.global_window != nullptr)
+        {
+            stream.global_window->release();
+        }
+        stream.window.release();
     }
 
-    exec::task<void> writeImages(Output output, std::shared_ptr<QueueScheduler<std::optional<Image>>> queue)
+    // Moves the awaiting coroutine to the pool, enqueued with `affinity` while the suspended thread keeps its own hint
+    struct [[nodiscard]] PoolHop
+    {
+        Context* context {nullptr};
+        StreamAffinity affinity;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            StreamAffinityScope affinity_scope(affinity);
+            stdexec::start_detached(stdexec::schedule(context->m_pool.get_scheduler()) | stdexec::then([handle] { handle.resume(); }));
+        }
+        void await_resume() const noexcept {}
+    };
+    PoolHop resumeOnPool(StreamAffinity affinity)
+    {
+        return PoolHop{this, affinity};
+    }
+
+    exec::task<void> writeImages(std::shared_ptr<Output> output, std::shared_ptr<Stream> stream, StreamOptions options)
+    {
+        TRACE_ASYNC_EVENT();
+        WriteCoalescing coalescing = options.coalescing;
+        if(output->isAsync())
+        {
+            coalescing.max_frames = std::min(coalescing.max_frames, FrameWriter::MAX_BATCH);
+        }
+        exec::async_scope writers;
+        for(uint32_t i = 0; i < options.writer_count; ++i)
+        {
+            writers.spawn(writeImagesSerial(output, stream, coalescing));
+        }
+        co_await writers.on_empty();
+    }
+
+    exec::task<void> writeImagesSerial(std::shared_ptr<Output> output, std::shared_ptr<Stream> stream, WriteCoalescing coalescing)
     {
         using stdexec::when_all;
         using stdexec::then;
         using stdexec::just;
         using stdexec::on;
-        OPTICK_EVENT();
-        while(std::optional<Image> image = co_await (*queue))
+        TRACE_ASYNC_EVENT();
+        JobMetrics& metrics = *stream->job.metrics;
+        while(std::optional<Image> image = co_await stream->queue)
+        {
+            if(stream->job.stopped())
+            {
+                // Dropping the frame gives its buffers back to the frame pool, the queue is drained until the reader closes it
+                image.reset();
+                metrics.addDropped(1);
+                releaseFrameSlot(*stream);
+                continue;
+            }
+            const StreamAffinity write_affinity {stream->preferred_worker, stream->write_priority};
+            std::vector<Image> batch = co_await coalesceFrames(std::move(*image), *stream, coalescing, write_affinity);
+            const std::size_t frame_count = batch.size();
+            std::size_t bytes = 0;
+            for(const Image& frame : batch)
+            {
+                bytes += frame.getChannels().byteSize();
+            }
+            try
+            {
+                if(output->isAsync())
+                {
+                    // Only the wall time, the kernel does the writing
+                    const auto start = std::chrono::steady_clock::now();
+                    co_await output->writeAsync(std::move(batch));
+                    const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+                    metrics.addTime(JobStage::Write, elapsed);
+                    m_metrics.stage(MetricStage::Write).record(elapsed);
+                }
+                else
+                {
+                    if(write_affinity.priority == StreamPriority::Latency)
+                    {
+                        // The write would run inline on the thread which published the frame, typically a bulk transform
+                        co_await resumeOnPool(write_affinity);
+                    }
+                    co_await (when_all(just(std::move(batch)), just(output.get()), just(&metrics), just(&m_metrics.stage(MetricStage::Write)))
+                              | then([](std::vector<Image> batch, Output* output, JobMetrics* metrics, LatencyHistogram* latency)
+                                     {
+                                         WorkerThreadScope worker_scope;
+                                         JobMetrics::StageTimer timer(metrics, JobStage::Write);
+                                         LatencyHistogram::Timer latency_timer(latency);
+                                         output->write(batch);
+                                     }));
+                }
+                metrics.addWritten(frame_count, bytes);
+            }
+            catch(...)
+            {
+                stream->job.fail(std::current_exception());
+                metrics.addDropped(frame_count);
+            }
+            if(output->isAsync())
+            {
+                // Resumed by the completion thread of the writer, don't keep it busy
+                co_await resumeOnPool(write_affinity);
+            }
+            for(std::size_t i = 0; i < frame_count; ++i)
+            {
+                releaseFrameSlot(*stream);
+            }
+        }
+    }
+    // Appends the frames which follow `first` in queue order until a limit of the coalescing is reached
+    exec::task<std::vector<Image>> coalesceFrames(Image first, Stream& stream, WriteCoalescing coalescing, StreamAffinity affinity)
+    {
+        TRACE_ASYNC_EVENT();
+        std::vector<Image> batch;
+        std::size_t bytes = std::as_const(first).getChannels().byteSize();
+        batch.push_back(std::move(first));
+        const auto deadline = std::chrono::steady_clock::now() + coalescing.max_latency;
+        while(batch.size() < coalescing.max_frames && bytes < coalescing.max_bytes)
         {
-            co_await (when_all(just(std::move(*image)), just(&output)) 
-                      | then([](Image image, Output* output)
-                             {
-                                 output->write(image);
-                             }));
+            std::optional<std::optional<Image>> next = stream.queue.tryTake();
+            if(!next)
+            {
+                if(std::chrono::steady_clock::now() >= deadline)
+                {
+                    break;
+                }
+                // No worker waits, resumed by the next published frame or by the timer at the deadline
+                next = co_await stream.queue.takeUntil(deadline, m_timer);
+                if(!next)
+                {
+                    // Resumed on the timer's thread
+                    co_await resumeOnPool(affinity);
+                    break;
+                }
+            }
+            if(!*next)
+            {
+                // Drained, the next co_await of the queue ends the writer
+                break;
+            }
+            bytes += std::as_const(**next).getChannels().byteSize();
+            batch.push_back(std::move(**next));
         }
+        co_return batch;
     }
-    exec::task<void> readImages(Input input, std::shared_ptr<QueueScheduler<std::optional<Image>>> queue)
+    exec::task<void> readImages(Input input, std::shared_ptr<Stream> stream, StreamOptions options)
     {
         using stdexec::when_all;
         using stdexec::then;
         using stdexec::just;
         using stdexec::on;
-        OPTICK_EVENT();
-        stdexec::sender_of<stdexec::set_value_t(std::optional<Image>)> auto reading_sender = readImage(&input);
-        AsyncReader<std::optional<Image>, decltype(reading_sender)> reader(reading_sender, &m_scope);
+        TRACE_ASYNC_EVENT();
+        auto frames = Input::frames<READ_AHEAD_DEPTH>(std::move(input), m_pool.get_scheduler(), stream->job.metrics, &m_metrics.stage(MetricStage::Read));
         auto as_optional = [](auto value) { return std::optional{std::move(value)}; };
-        while(std::optional<Image> image = co_await reader.asyncRead())
+        try
+        {
+            while(std::optional<Image> image = co_await frames.next())
+            {
+                stream->read_ahead_frames.store(static_cast<uint32_t>(frames.buffered()), std::memory_order_relaxed);
+                // Suspends while the window is full, the writers resume it when a frame is written
+                co_await acquireFrameSlot(*stream);
+                if(stream->job.stopped())
+                {
+                    stream->job.metrics->addDropped(1);
+                    releaseFrameSlot(*stream);
+                    break;
+                }
+                // The transform is enqueued by push, the hint of the thread is restored before the next co_await
+                StreamAffinityScope affinity({stream->preferred_worker, StreamPriority::Bulk});
+                if(options.fork_join)
+                {
+                    stream->queue.push(transformForkJoin(std::move(*image), options.tiles_per_half, stream->job) | then(as_optional));
+                }
+                else
+                {
+                    stream->queue.push(transform(std::move(*image), stream->job) | then(as_optional));
+                }
+            }
+        }
+        catch(...)
         {
-            queue->push(transform(*image) | then(as_optional));
+            // A failed read, the frames already queued are dropped by the writers
+            stream->job.fail(std::current_exception());
         }
-        queue->push(just(std::nullopt));
+        // The body may be reading the next frame, it must not outlive the job (it records into the context's metrics)
+        co_await frames.close();
+        // Read but never queued, frames_read has to add up to written + dropped
+        stream->job.metrics->addDropped(frames.buffered());
+        stream->read_ahead_frames.store(0, std::memory_order_relaxed);
+        stream->queue.close();
 
     }
 
+    // Declared first so it is destroyed last, the backends of the frames read their channels on it
+    exec::static_thread_pool m_io_pool{IO_THREAD_COUNT};
     THREAD_POOL m_pool{32};
     exec::async_scope m_scope;
+    PipelineMetrics m_metrics;
     Pipeline m_pipeline;
+    // Guarded by m_streams_mutex
+    std::shared_ptr<AsyncSemaphore> m_global_window;
+    std::atomic<uint32_t> m_next_stream_worker {0};
+    JobAdmission m_admission;
+    // Wakes up the writers waiting for the next frame of a batch
+    DeadlineTimer m_timer;
+    std::mutex m_streams_mutex;
+    std::vector<std::weak_ptr<Stream>> m_streams;
+    // Shared with the inputs and the recycled backends, so it can outlive the context (see detachIoScheduler)
+    std::shared_ptr<FramePool> m_frame_pool {std::make_shared<FramePool>(m_io_pool.get_scheduler())};
+    // Declared last so it is stopped before the members it reads are destroyed
+    std::unique_ptr<MetricsDumper> m_metrics_dumper;
 };
\ No newline at end of file
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+/*
+Calls the callbacks at their deadline on its own thread, so a coroutine waiting for "an event or a timeout"
+doesn't keep a worker busy. The callbacks are expected to be short (e.g. resume a coroutine which moves to a pool).
+*/
+class DeadlineTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    struct Handle
+    {
+        Clock::time_point deadline;
+        uint64_t id {0};
+    };
+
+    DeadlineTimer()
+    : m_thread([this] { run(); })
+    {}
+    ~DeadlineTimer()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+    DeadlineTimer(const DeadlineTimer&) = delete;
+    DeadlineTimer& operator=(const DeadlineTimer&) = delete;
+
+    Handle at(Clock::time_point deadline, std::function<void()> callback)
+    {
+        std::unique_lock lock(m_mutex);
+        const Handle handle{deadline, ++m_next_id};
+        const bool earliest = m_timers.empty() || deadline < m_timers.begin()->first.first;
+        m_timers.emplace(std::pair{deadline, handle.id}, std::move(callback));
+        lock.unlock();
+        if(earliest)
+        {
+            m_wake.notify_one();
+        }
+        return handle;
+    }
+    // The callback won't be called once it returns, waits for it if it is running (unless called by the callback itself)
+    void cancel(const Handle& handle)
+    {
+        if(handle.id == 0)
+        {
+            // Never armed
+            return;
+        }
+        std::unique_lock lock(m_mutex);
+        m_timers.erase(std::pair{handle.deadline, handle.id});
+        if(std::this_thread::get_id() != m_thread.get_id())
+        {
+            m_done.wait(lock, [this, &handle] { return m_running != handle.id; });
+        }
+    }
+private:
+    void run()
+    {
+        std::unique_lock lock(m_mutex);
+        while(m_stop == false)
+        {
+            if(m_timers.empty())
+            {
+                m_wake.wait(lock);
+                continue;
+            }
+            auto first = m_timers.begin();
+            if(Clock::now() < first->first.first)
+            {
+                m_wake.wait_until(lock, first->first.first);
+                continue;
+            }
+            std::function<void()> callback = std::move(first->second);
+            m_running = first->first.second;
+            m_timers.erase(first);
+            lock.unlock();
+            callback();
+            lock.lock();
+            m_running = 0;
+            m_done.notify_all();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::map<std::pair<Clock::time_point, uint64_t>, std::function<void()>> m_timers;
+    uint64_t m_next_id {0};
+    // The id of the callback being called, 0 if none
+    uint64_t m_running {0};
+    bool m_stop {false};
+    // Declared last, the thread uses the other members
+    std::thread m_thread;
+};
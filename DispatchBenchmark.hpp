@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+#include "Trace.hpp"
+
+#include "Backend.hpp"
+
+/*
+Colorizes a one pixel frame, once through the Backend vtable and once through visitBackend. The kernel does almost
+nothing on it, so the figure is the cost of the call itself.
+Only meaningful with SANDBOX_TRACE_BACKEND=None, otherwise the trace scope of colorizeTile is what gets timed.
+*/
+inline void runDispatchBenchmark(uint32_t iterations = 50'000'000)
+{
+    TRACE_EVENT();
+#if defined(SANDBOX_TRACE_NONE)
+    using clock = std::chrono::steady_clock;
+
+    auto measure = [&](const char* mode, auto&& colorizeTile)
+    {
+        std::unique_ptr<Backend> backend = BackendFactory::createBackend(1, 1);
+        const auto begin = clock::now();
+        for(uint32_t i = 0; i < iterations; ++i)
+        {
+            colorizeTile(*backend);
+        }
+        const std::chrono::duration<double, std::nano> elapsed = clock::now() - begin;
+        std::cout << "Dispatch benchmark " << mode << ": " << elapsed.count() / iterations << " ns per call" << std::endl;
+    };
+    measure("virtual", [](Backend& backend) { backend.colorizeTile(0, 1); });
+    measure("static", [](Backend& backend)
+    {
+        visitBackend(backend, [](auto& concrete) { concrete.colorizeTile(0, 1); });
+    });
+#else
+    std::cout << "Dispatch benchmark: build with SANDBOX_TRACE_BACKEND=None" << std::endl;
+#endif
+}
@@ -7,18 +7,38 @@ class Server
     void startProcessing(Input input, Output output)
     {
 
-        OPTICK_EVENT();
-        m_context.spawn2(std::move(input), std::move(output), [](){std::cout << "Processing finished;" << std::endl;});
+        TRACE_EVENT();
+        m_context.spawn2(std::move(input), std::move(output), [](const JobResult& result)
+        {
+            using std::chrono::duration_cast;
+            using std::chrono::milliseconds;
+            std::cout << "Processing finished; frames: " << result.frames_written << "/" << result.frames_read
+                      << " transform cpu: " << duration_cast<milliseconds>(result.stage(JobStage::Transform).cpu).count() << "ms"
+                      << " total: " << duration_cast<milliseconds>(result.duration).count() << "ms" << std::endl;
+            if(result.error)
+            {
+                try
+                {
+                    std::rethrow_exception(result.error);
+                }
+                catch(const std::exception& e)
+                {
+                    std::cout << "Processing failed: " << e.what() << std::endl;
+                }
+            }
+        });
     }
     void actBusy()
     {
-        OPTICK_EVENT("HandlingRequestOrWhatever");
+        TRACE_EVENT("HandlingRequestOrWhatever");
         using namespace std::chrono_literals;
         busyWait(durations::busy_operation);
     }
     void run()
     {
-        OPTICK_EVENT();
+        TRACE_EVENT();
+        // The burst below is admitted a few jobs at a time, so the first ones finish instead of all slowing down
+        m_context.setMaxConcurrentJobs(MAX_CONCURRENT_JOBS);
         startProcessing(Input{"Input 01"}, Output{});
         startProcessing(Input{"Input 02"}, Output{});
         startProcessing(Input{"Input 03"}, Output{});
@@ -38,6 +58,7 @@ class Server
     }
 
     private:
+    static constexpr const uint32_t MAX_CONCURRENT_JOBS = 4;
     Context<tbbexec::tbb_thread_pool> m_context{32};
 };
 
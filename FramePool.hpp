@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "Backend.hpp"
+#include "Channels.hpp"
+
+/*
+Recycles the backends and pixel planes of the frames of a Context. A backend goes back to the pool when the
+last image sharing it is destroyed (after Output::write), its planes are cached by size in the plane pool.
+*/
+class FramePool : public std::enable_shared_from_this<FramePool>
+{
+public:
+    static constexpr const uint32_t DEFAULT_MAX_CACHED_BACKENDS = 64;
+
+    explicit FramePool(std::optional<Backend::IoScheduler> io_scheduler = std::nullopt,
+                       std::size_t max_cached_bytes = PlanePool::DEFAULT_MAX_CACHED_BYTES,
+                       uint32_t max_cached_backends = DEFAULT_MAX_CACHED_BACKENDS)
+    : m_plane_pool(std::make_shared<PlanePool>(max_cached_bytes))
+    , m_io_scheduler(std::move(io_scheduler))
+    , m_max_cached_backends(max_cached_backends)
+    {}
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // The pool has to be owned by a shared_ptr, the backends return to it only while it is alive
+    std::shared_ptr<Backend> createBackend(uint32_t width, uint32_t height)
+    {
+        std::unique_ptr<Backend> backend = takeCachedBackend();
+        if(backend == nullptr)
+        {
+            backend = BackendFactory::createBackend();
+        }
+        {
+            // Also set on the recycled backends, they may have been created before detachIoScheduler
+            std::lock_guard lock(m_mutex);
+            backend->setIoScheduler(m_io_scheduler);
+        }
+        backend->reconstructFromChannels(Backend::Channels(width, height, m_plane_pool));
+        return std::shared_ptr<Backend>(backend.release(), Recycler{weak_from_this()});
+    }
+    // Called when the owner of the I/O threads shuts them down, the backends created afterwards read synchronously
+    void detachIoScheduler()
+    {
+        std::lock_guard lock(m_mutex);
+        m_io_scheduler.reset();
+    }
+    const std::shared_ptr<PlanePool>& getPlanePool() const { return m_plane_pool; }
+    std::size_t cachedBytes() const { return m_plane_pool->cachedBytes(); }
+private:
+    struct Recycler
+    {
+        std::weak_ptr<FramePool> pool;
+        void operator()(Backend* backend) const
+        {
+            std::unique_ptr<Backend> owned(backend);
+            if(std::shared_ptr<FramePool> frame_pool = pool.lock())
+            {
+                frame_pool->recycle(std::move(owned));
+            }
+        }
+    };
+    std::unique_ptr<Backend> takeCachedBackend()
+    {
+        std::lock_guard lock(m_mutex);
+        if(m_backends.empty())
+        {
+            return nullptr;
+        }
+        std::unique_ptr<Backend> backend = std::move(m_backends.back());
+        m_backends.pop_back();
+        return backend;
+    }
+    void recycle(std::unique_ptr<Backend> backend)
+    {
+        // The planes go back to the plane pool here, outside of the lock
+        backend->reconstructFromChannels(Backend::Channels{});
+        std::lock_guard lock(m_mutex);
+        if(m_backends.size() < m_max_cached_backends)
+        {
+            m_backends.push_back(std::move(backend));
+        }
+    }
+
+    std::shared_ptr<PlanePool> m_plane_pool;
+    std::mutex m_mutex;
+    // Guarded by m_mutex
+    std::optional<Backend::IoScheduler> m_io_scheduler;
+    std::vector<std::unique_ptr<Backend>> m_backends;
+    const uint32_t m_max_cached_backends;
+};
@@ -0,0 +1,452 @@
+#include "FrameWriter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Trace.hpp"
+
+namespace
+{
+    int ioUringSetup(uint32_t entries, io_uring_params* params)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+    }
+    int ioUringEnter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+    {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+    // The ring indices are shared with the kernel
+    unsigned loadAcquire(unsigned* value) { return std::atomic_ref<unsigned>(*value).load(std::memory_order_acquire); }
+    void storeRelease(unsigned* value, unsigned new_value) { std::atomic_ref<unsigned>(*value).store(new_value, std::memory_order_release); }
+
+    // Marks the no-op which wakes up the completion thread to stop
+    constexpr const uint64_t STOP_USER_DATA = 0;
+}
+
+// Submission and completion queues shared with the kernel (the raw io_uring interface, no liburing)
+struct FrameWriter::Ring
+{
+    ~Ring()
+    {
+        if(sqes != nullptr)
+        {
+            ::munmap(sqes, sqes_size);
+        }
+        if(cq_mapping != nullptr && cq_mapping != sq_mapping)
+        {
+            ::munmap(cq_mapping, cq_size);
+        }
+        if(sq_mapping != nullptr)
+        {
+            ::munmap(sq_mapping, sq_size);
+        }
+        if(fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+    // Returns nullptr if io_uring is not available
+    static std::unique_ptr<Ring> create(uint32_t entries)
+    {
+        auto ring = std::make_unique<Ring>();
+        io_uring_params params {};
+        ring->fd = ioUringSetup(entries, &params);
+        if(ring->fd < 0)
+        {
+            return nullptr;
+        }
+        ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if(single_mapping)
+        {
+            ring->sq_size = ring->cq_size = std::max(ring->sq_size, ring->cq_size);
+        }
+        ring->sq_mapping = map(ring->fd, ring->sq_size, IORING_OFF_SQ_RING);
+        if(ring->sq_mapping == nullptr)
+        {
+            return nullptr;
+        }
+        ring->cq_mapping = single_mapping ? ring->sq_mapping : map(ring->fd, ring->cq_size, IORING_OFF_CQ_RING);
+        ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        ring->sqes = static_cast<io_uring_sqe*>(map(ring->fd, ring->sqes_size, IORING_OFF_SQES));
+        if(ring->cq_mapping == nullptr || ring->sqes == nullptr)
+        {
+            return nullptr;
+        }
+        auto* sq = static_cast<uint8_t*>(ring->sq_mapping);
+        ring->sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        ring->sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        ring->sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        ring->sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        ring->sq_entries = params.sq_entries;
+        auto* cq = static_cast<uint8_t*>(ring->cq_mapping);
+        ring->cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        ring->cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        ring->cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return ring;
+    }
+    static void* map(int fd, std::size_t size, off_t offset)
+    {
+        void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return mapping == MAP_FAILED ? nullptr : mapping;
+    }
+    // Only called under FrameWriter::m_mutex, we are the single producer of the submission queue
+    io_uring_sqe& nextSqe()
+    {
+        unsigned tail = *sq_tail;
+        if(tail - loadAcquire(sq_head) >= sq_entries)
+        {
+            // The kernel consumes the entries while entering, so the queue is empty afterwards
+            enter(tail - submitted_tail);
+        }
+        const unsigned index = tail & sq_mask;
+        sq_array[index] = index;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        return sqe;
+    }
+    void commit()
+    {
+        storeRelease(sq_tail, *sq_tail + 1);
+    }
+    void enter(unsigned to_submit)
+    {
+        while(to_submit != 0)
+        {
+            const int submitted = ioUringEnter(fd, to_submit, 0, 0);
+            if(submitted < 0)
+            {
+                if(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "io_uring_enter failed");
+            }
+            to_submit -= static_cast<unsigned>(submitted);
+            submitted_tail += static_cast<unsigned>(submitted);
+        }
+    }
+    void submitPending()
+    {
+        enter(*sq_tail - submitted_tail);
+    }
+    // Withdraws the entries the kernel didn't take after enter failed, they must not be submitted by a later call
+    void discardPending()
+    {
+        storeRelease(sq_tail, submitted_tail);
+    }
+
+    int fd {-1};
+    void* sq_mapping {nullptr};
+    std::size_t sq_size {0};
+    void* cq_mapping {nullptr};
+    std::size_t cq_size {0};
+    io_uring_sqe* sqes {nullptr};
+    std::size_t sqes_size {0};
+    unsigned* sq_head {nullptr};
+    unsigned* sq_tail {nullptr};
+    unsigned sq_mask {0};
+    unsigned* sq_array {nullptr};
+    unsigned sq_entries {0};
+    unsigned submitted_tail {0};
+    unsigned* cq_head {nullptr};
+    unsigned* cq_tail {nullptr};
+    unsigned cq_mask {0};
+    io_uring_cqe* cqes {nullptr};
+};
+
+void FrameWriter::Awaiter::await_resume()
+{
+    if(const int error = m_error.load(std::memory_order_acquire); error != 0)
+    {
+        throw std::system_error(error, std::generic_category(), "Frame write failed");
+    }
+}
+
+FrameWriter::FrameWriter(const std::string& path)
+{
+    TRACE_EVENT();
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(m_fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), "Can't open output file " + path);
+    }
+    std::memcpy(m_header.magic, RawFrameFile::MAGIC, sizeof(RawFrameFile::MAGIC));
+    m_ring = Ring::create(QUEUE_DEPTH);
+    if(m_ring != nullptr)
+    {
+        m_reaper = std::thread([this] { reapCompletions(); });
+    }
+    else
+    {
+        m_fallback_pool = std::make_unique<exec::static_thread_pool>(FALLBACK_THREAD_COUNT);
+    }
+}
+FrameWriter::~FrameWriter()
+{
+    if(m_ring != nullptr)
+    {
+        // The completion thread keeps reaping until the writes in flight (and their resubmissions) are done
+        m_stopping.store(true, std::memory_order_release);
+        try
+        {
+            std::lock_guard lock(m_mutex);
+            io_uring_sqe& sqe = m_ring->nextSqe();
+            sqe.opcode = IORING_OP_NOP;
+            sqe.user_data = STOP_USER_DATA;
+            m_ring->commit();
+            m_ring->submitPending();
+        }
+        catch(const std::exception& error)
+        {
+            // The completion thread is failing to enter the ring too, it polls and sees m_stopping
+            std::cerr << "Can't wake up the completion thread: " << error.what() << std::endl;
+        }
+        m_reaper.join();
+        m_ring.reset();
+    }
+    else
+    {
+        stdexec::sync_wait(m_fallback_scope.on_empty());
+        m_fallback_pool.reset();
+    }
+    // The frame count is known only now
+    if(::pwrite(m_fd, &m_header, sizeof(m_header), 0) != static_cast<ssize_t>(sizeof(m_header)))
+    {
+        std::cerr << "Can't write the header of the frame file: " << std::strerror(errno) << std::endl;
+    }
+    ::close(m_fd);
+}
+FrameWriter::Awaiter FrameWriter::write(std::vector<Image> frames)
+{
+    if(frames.size() > MAX_BATCH)
+    {
+        throw std::invalid_argument("Too many frames in one write");
+    }
+    std::lock_guard lock(m_mutex);
+    for(const Image& frame : frames)
+    {
+        const PlanarChannels& channels = frame.getChannels();
+        if(m_header.frame_count == 0 && m_header.stride == 0)
+        {
+            m_header.width = channels.width;
+            m_header.height = channels.height;
+            m_header.stride = channels.stride;
+        }
+        if(channels.width != m_header.width || channels.height != m_header.height || channels.stride != m_header.stride)
+        {
+            throw std::invalid_argument("The frames of a frame file have to be the same size");
+        }
+    }
+    return Awaiter{this, std::move(frames)};
+}
+void FrameWriter::submit(Awaiter& awaiter)
+{
+    TRACE_EVENT();
+    const uint32_t count = static_cast<uint32_t>(awaiter.m_frames.size());
+    std::unique_lock lock(m_mutex);
+    const std::size_t frame_bytes = std::size_t{m_header.stride} * m_header.height * PlanarChannels::Count * sizeof(float);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        Request& request = awaiter.m_requests[i];
+        // Read only, a frame shared with another image isn't detached
+        const PlanarChannels& channels = std::as_const(awaiter.m_frames[i]).getChannels();
+        request.batch = &awaiter;
+        request.first_buffer = 0;
+        request.offset = sizeof(RawFrameFile::Header) + frame_bytes * m_header.frame_count++;
+        request.bytes = 0;
+        for(uint32_t channel = 0; channel < PlanarChannels::Count; ++channel)
+        {
+            const AlignedPlane& plane = channels.planes[channel];
+            request.buffers[channel] = iovec{const_cast<float*>(plane.data()), plane.size() * sizeof(float)};
+            request.bytes += plane.size() * sizeof(float);
+        }
+    }
+    if(m_ring != nullptr)
+    {
+        submitToRing(awaiter, count, lock);
+    }
+    else
+    {
+        lock.unlock();
+        submitToFallback(awaiter, count);
+    }
+}
+void FrameWriter::submitToRing(Awaiter& awaiter, uint32_t count, std::unique_lock<std::mutex>& lock)
+{
+    // Counted before the kernel can complete them, the requests it doesn't take are subtracted below
+    m_in_flight.fetch_add(count, std::memory_order_relaxed);
+    const unsigned batch_tail = m_ring->submitted_tail;
+    uint32_t submitted = count;
+    int error = 0;
+    try
+    {
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            prepareRingWrite(awaiter.m_requests[i]);
+        }
+        // One system call for the whole batch
+        m_ring->submitPending();
+    }
+    catch(const std::system_error& system_error)
+    {
+        m_ring->discardPending();
+        submitted = m_ring->submitted_tail - batch_tail;
+        error = system_error.code().value();
+        // Nothing was placed after them, the file ends with the last submitted frame
+        m_header.frame_count -= count - submitted;
+        m_in_flight.fetch_sub(count - submitted, std::memory_order_acq_rel);
+    }
+    // Completing the last request resumes the writer, which can write again
+    lock.unlock();
+    for(uint32_t i = submitted; i < count; ++i)
+    {
+        complete(awaiter.m_requests[i], error);
+    }
+}
+void FrameWriter::prepareRingWrite(Request& request)
+{
+    io_uring_sqe& sqe = m_ring->nextSqe();
+    sqe.opcode = IORING_OP_WRITEV;
+    sqe.fd = m_fd;
+    sqe.addr = reinterpret_cast<uint64_t>(request.buffers.data() + request.first_buffer);
+    sqe.len = static_cast<uint32_t>(request.buffers.size() - request.first_buffer);
+    sqe.off = request.offset;
+    sqe.user_data = reinterpret_cast<uint64_t>(&request);
+    m_ring->commit();
+}
+void FrameWriter::submitToFallback(Awaiter& awaiter, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        Request* request = &awaiter.m_requests[i];
+        m_fallback_scope.spawn(stdexec::schedule(m_fallback_pool->get_scheduler()) | stdexec::then([this, request]
+        {
+            TRACE_EVENT("FrameWriter::pwritev");
+            complete(*request, writeAll(*request));
+        }));
+    }
+}
+int FrameWriter::writeAll(Request& request) const
+{
+    while(request.bytes != 0)
+    {
+        const ssize_t written = ::pwritev(m_fd, request.buffers.data() + request.first_buffer,
+                                          static_cast<int>(request.buffers.size() - request.first_buffer), static_cast<off_t>(request.offset));
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+        if(written == 0)
+        {
+            // No progress, the file can't grow (e.g. the disk is full)
+            return EIO;
+        }
+        advance(request, static_cast<std::size_t>(written));
+    }
+    return 0;
+}
+bool FrameWriter::advance(Request& request, std::size_t written)
+{
+    request.offset += written;
+    request.bytes -= written;
+    while(written != 0)
+    {
+        iovec& buffer = request.buffers[request.first_buffer];
+        const std::size_t consumed = std::min(written, buffer.iov_len);
+        buffer.iov_base = static_cast<uint8_t*>(buffer.iov_base) + consumed;
+        buffer.iov_len -= consumed;
+        written -= consumed;
+        if(buffer.iov_len == 0)
+        {
+            ++request.first_buffer;
+        }
+    }
+    return request.bytes == 0;
+}
+void FrameWriter::reapCompletions()
+{
+    TRACE_THREAD("FrameWriter completions");
+    std::chrono::milliseconds backoff {0};
+    while(m_stopping.load(std::memory_order_acquire) == false || m_in_flight.load(std::memory_order_acquire) != 0)
+    {
+        if(ioUringEnter(m_ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            // A persistent error would spin, the completion queue is polled with a growing pause instead
+            if(backoff.count() == 0)
+            {
+                std::cerr << "Waiting for io_uring completions failed: " << std::strerror(errno) << std::endl;
+            }
+            backoff = std::clamp(backoff * 2, std::chrono::milliseconds{1}, MAX_REAP_BACKOFF);
+            std::this_thread::sleep_for(backoff);
+        }
+        else
+        {
+            backoff = std::chrono::milliseconds{0};
+        }
+        unsigned head = *m_ring->cq_head;
+        const unsigned tail = loadAcquire(m_ring->cq_tail);
+        for(; head != tail; ++head)
+        {
+            const io_uring_cqe& cqe = m_ring->cqes[head & m_ring->cq_mask];
+            if(cqe.user_data != STOP_USER_DATA)
+            {
+                onRingWriteCompleted(*reinterpret_cast<Request*>(cqe.user_data), cqe.res);
+            }
+        }
+        storeRelease(m_ring->cq_head, head);
+    }
+}
+void FrameWriter::onRingWriteCompleted(Request& request, int result)
+{
+    const bool retry = result == -EINTR || result == -EAGAIN;
+    if(retry || (result > 0 && advance(request, static_cast<std::size_t>(result)) == false))
+    {
+        // The rest of a short write, the request stays in flight
+        std::lock_guard lock(m_mutex);
+        try
+        {
+            prepareRingWrite(request);
+            m_ring->submitPending();
+            return;
+        }
+        catch(const std::system_error& error)
+        {
+            m_ring->discardPending();
+            result = -error.code().value();
+        }
+    }
+    m_in_flight.fetch_sub(1, std::memory_order_acq_rel);
+    complete(request, result < 0 ? -result : (request.bytes != 0 ? EIO : 0));
+}
+void FrameWriter::complete(Request& request, int error)
+{
+    Awaiter& awaiter = *request.batch;
+    if(error != 0)
+    {
+        int expected = 0;
+        awaiter.m_error.compare_exchange_strong(expected, error, std::memory_order_release);
+    }
+    if(awaiter.m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        awaiter.m_awaiting_coroutine.resume();
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <exec/async_scope.hpp>
+#include <exec/static_thread_pool.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "Image.hpp"
+#include "RawFrameFile.hpp"
+
+/*
+Writes frames into a raw frame file (see RawFrameFile) asynchronously. The frames of a co_await write(...) are
+submitted with a single io_uring_enter call and the awaiting coroutine is resumed by the completion thread
+when all of them are on the file, so no pool worker waits for the kernel.
+Without io_uring (old kernel, seccomp) the frames are written with pwritev on a small thread pool instead.
+Frames are placed in the file in the order of the write calls.
+*/
+class FrameWriter
+{
+public:
+    static constexpr const uint32_t MAX_BATCH = 8;
+    static constexpr const uint32_t QUEUE_DEPTH = 64;
+    static constexpr const uint32_t FALLBACK_THREAD_COUNT = 2;
+    // Longest pause of the completion thread while io_uring_enter keeps failing
+    static constexpr const std::chrono::milliseconds MAX_REAP_BACKOFF {100};
+
+    class Awaiter;
+    // A short write advances the buffers and the offset, the rest of the frame is written by the next submission
+    struct Request
+    {
+        Awaiter* batch {nullptr};
+        std::array<iovec, PlanarChannels::Count> buffers {};
+        // The buffers before it are written
+        uint32_t first_buffer {0};
+        uint64_t offset {0};
+        // Left to write
+        std::size_t bytes {0};
+    };
+    class [[nodiscard]] Awaiter
+    {
+    public:
+        Awaiter(FrameWriter* writer, std::vector<Image> frames)
+        : m_writer(writer)
+        , m_frames(std::move(frames))
+        , m_remaining(static_cast<uint32_t>(m_frames.size()))
+        {}
+        Awaiter(const Awaiter&) = delete;
+        Awaiter& operator=(const Awaiter&) = delete;
+
+        bool await_ready() { return m_frames.empty(); }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            m_awaiting_coroutine = handle;
+            // Can be resumed on the completion thread before submit returns, the awaiter must not be touched afterwards
+            m_writer->submit(*this);
+        }
+        void await_resume();
+    private:
+        friend class FrameWriter;
+        FrameWriter* m_writer {nullptr};
+        std::vector<Image> m_frames;
+        std::array<Request, MAX_BATCH> m_requests {};
+        std::atomic<uint32_t> m_remaining {0};
+        std::atomic<int> m_error {0};
+        std::coroutine_handle<> m_awaiting_coroutine = std::noop_coroutine();
+    };
+
+    explicit FrameWriter(const std::string& path);
+    // Waits for the submitted writes and completes the header of the file
+    ~FrameWriter();
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    // At most MAX_BATCH frames of the same size as the previous ones
+    Awaiter write(std::vector<Image> frames);
+    bool usesIoUring() const { return m_ring != nullptr; }
+private:
+    struct Ring;
+
+    void submit(Awaiter& awaiter);
+    // Fails the requests the kernel didn't take, outside of `lock`
+    void submitToRing(Awaiter& awaiter, uint32_t count, std::unique_lock<std::mutex>& lock);
+    void submitToFallback(Awaiter& awaiter, uint32_t count);
+    // Only called under m_mutex
+    void prepareRingWrite(Request& request);
+    void reapCompletions();
+    void onRingWriteCompleted(Request& request, int result);
+    // Returns 0 or the errno of the failed write
+    int writeAll(Request& request) const;
+    // Skips `written` bytes of the request, returns true if nothing is left
+    static bool advance(Request& request, std::size_t written);
+    static void complete(Request& request, int error);
+
+    int m_fd {-1};
+    std::mutex m_mutex;
+    RawFrameFile::Header m_header {};
+    std::unique_ptr<Ring> m_ring;
+    // Submitted to the ring and not completed, the completion thread stops once it is zero after m_stopping
+    std::atomic<uint32_t> m_in_flight {0};
+    std::atomic<bool> m_stopping {false};
+    std::thread m_reaper;
+    std::unique_ptr<exec::static_thread_pool> m_fallback_pool;
+    exec::async_scope m_fallback_scope;
+};
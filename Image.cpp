@@ -1,41 +1,102 @@
 #include "Image.hpp"
 
+#include <atomic>
 #include <iostream>
 
 #include <chrono>
 #include <thread>
 
-#include <optick.h>
+#include "Trace.hpp"
 
 #include "ChannelView.hpp"
-Image::Image(std::string name)
+Image::Image(std::string name, uint32_t width, uint32_t height)
     : m_name(std::move(name))
+    , m_backend(BackendFactory::createBackend(width, height))
 {}
-Image::Image(std::string name, const Backend::Channels& channels)
+Image::Image(std::string name, std::shared_ptr<Backend> backend)
+    : m_name(std::move(name))
+    , m_backend(std::move(backend))
+{}
+Image::Image(std::string name, Backend::Channels channels)
     : Image(std::move(name))
 {
-    m_backend->reconstructFromChannels(channels);
+    m_backend->reconstructFromChannels(std::move(channels));
+}
+void Image::detach()
+{
+    if(m_backend.use_count() == 1)
+    {
+        // Pairs with the release of the other owner, its reads of the shared pixels happen before our writes
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return;
+    }
+    TRACE_EVENT();
+    m_backend = m_backend->clone();
 }
 void Image::colorize()
 {
-    OPTICK_EVENT();
-    OPTICK_TAG("name", m_name.c_str());
-    m_backend->colorize();
+    TRACE_EVENT();
+    TRACE_TAG("name", m_name.c_str());
+    detach();
+    visitBackend(*m_backend, [](auto& backend) { backend.colorizeTile(0, 1); });
     std::cout << "Colorize: " << m_name << std::endl;
 }
 void Image::resize()
 {
-    OPTICK_EVENT();
-    OPTICK_TAG("name", m_name.c_str());
-    m_backend->resize();
+    TRACE_EVENT();
+    TRACE_TAG("name", m_name.c_str());
+    detach();
+    visitBackend(*m_backend, [](auto& backend)
+    {
+        backend.beginResize();
+        backend.resizeTile(0, 1);
+        backend.endResize();
+    });
     std::cout << "Resize: " << m_name << std::endl;
 }
+void Image::colorizeTile(uint32_t tile, uint32_t tile_count)
+{
+    TRACE_EVENT();
+    TRACE_TAG("name", m_name.c_str());
+    TRACE_TAG("tile", tile);
+    detach();
+    visitBackend(*m_backend, [=](auto& backend) { backend.colorizeTile(tile, tile_count); });
+    std::cout << "Colorize: " << m_name << " tile " << tile << "/" << tile_count << std::endl;
+}
+void Image::resizeTile(uint32_t tile, uint32_t tile_count)
+{
+    TRACE_EVENT();
+    TRACE_TAG("name", m_name.c_str());
+    TRACE_TAG("tile", tile);
+    detach();
+    visitBackend(*m_backend, [=](auto& backend) { backend.resizeTile(tile, tile_count); });
+    std::cout << "Resize: " << m_name << " tile " << tile << "/" << tile_count << std::endl;
+}
+void Image::beginResize()
+{
+    detach();
+    m_backend->beginResize();
+}
+void Image::endResize()
+{
+    detach();
+    m_backend->endResize();
+}
+void Image::copyTile(const Image& other, uint32_t tile, uint32_t tile_count)
+{
+    detach();
+    m_backend->copyTile(*other.m_backend, tile, tile_count);
+}
 
 
-Lazy<void> Image::changeColor(float)
+void Image::changeColor(Backend::Channels channels, float x)
 {
-    Backend::Channels channels = co_await m_backend->readChannels();
-    m_backend->reconstructFromChannels(channels);
+    TRACE_EVENT();
+    ChannelView view{std::move(channels)};
+    view.manipulateChannel(Backend::Channels::Alpha, ChannelKernels::Affine{x, 0.0f});
+    view.manipulateChannel(Backend::Channels::Alpha, ChannelKernels::Clamp{0.0f, 1.0f});
+    detach();
+    m_backend->reconstructFromChannels(std::move(view).takeChannels());
 }
 const std::string& Image::getName() const
 {
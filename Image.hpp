@@ -8,30 +8,49 @@ class Image
 {
     friend class ChannelView;
     public:
-        explicit Image(std::string name);
-        Image(std::string name, const Backend::Channels& channels);
-        Image(const Image& o)
-        : Image(o.getName())
-        {
-
-        }
+        explicit Image(std::string name, uint32_t width = 0, uint32_t height = 0);
+        Image(std::string name, Backend::Channels channels);
+        // Takes an already sized backend, e.g. one from a FramePool
+        Image(std::string name, std::shared_ptr<Backend> backend);
+        // Copies share the pixels, the first mutation of a shared image makes its own deep copy
+        Image(const Image& o) = default;
         Image(Image&& o) = default;
-
-        Image& operator=(const Image& o)
-        {
-            m_name = o.getName();
-            return *this;
-        }
+        Image& operator=(const Image& o) = default;
         Image& operator=(Image&&) = default;
         void colorize();
         void resize();
+        // Processes the tile-th horizontal band out of tile_count, different bands can be processed in parallel
+        void colorizeTile(uint32_t tile, uint32_t tile_count);
+        // The bands of a resize have to be surrounded by beginResize and endResize
+        void resizeTile(uint32_t tile, uint32_t tile_count);
+        void beginResize();
+        void endResize();
+        void copyTile(const Image& other, uint32_t tile, uint32_t tile_count);
+        /*
+        Deep copies the pixels if they are shared with another image, the mutating methods call it implicitly.
+        Has to be called before the tiles of a shared image are processed in parallel.
+        */
+        void detach();
+        bool isShared() const { return m_backend.use_count() > 1; }
 
         const std::string& getName() const;
-        Lazy<void> changeColor(float x);
+        uint32_t getWidth() const { return getChannels().width; }
+        uint32_t getHeight() const { return getChannels().height; }
+        const Backend::Channels& getChannels() const { return m_backend->getChannels(); }
+        Backend::Channels& getChannels()
+        {
+            detach();
+            return m_backend->getChannels();
+        }
+        // Completes on one of the I/O threads for the backends which read on them, continueOn a pool before processing
+        Lazy<Backend::Channels> readChannels() const
+        {
+            return visitBackend(*m_backend, [](const auto& backend) { return backend.readChannels(); });
+        }
+        // Scales the alpha of `channels` read from this image and stores them, runs on the calling thread
+        void changeColor(Backend::Channels channels, float x);
     private:
-        Lazy<Backend::Channels> readChannels() const { return m_backend->readChannels(); }
 
         std::string m_name;
-        std::unique_ptr<Backend> m_backend { BackendFactory::createBackend() };
+        std::shared_ptr<Backend> m_backend;
 };
-
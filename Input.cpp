@@ -5,22 +5,81 @@
 #include <chrono>
 #include <thread>
 #include <iostream>
+#include <vector>
 
-#include <optick.h>
+#include "Trace.hpp"
 
 #include "durations.hpp"
+
+namespace
+{
+    // Moving gradient, so the consecutive frames differ
+    void fillTestPattern(Backend::Channels& channels, uint32_t frame_number)
+    {
+        using Channels = Backend::Channels;
+        const float shift = static_cast<float>(frame_number % 64) / 64.0f;
+        for(uint32_t y = 0; y < channels.height; ++y)
+        {
+            const float vertical = static_cast<float>(y) / static_cast<float>(channels.height);
+            float* red = channels.row(Channels::Red, y);
+            float* green = channels.row(Channels::Green, y);
+            float* blue = channels.row(Channels::Blue, y);
+            float* alpha = channels.row(Channels::Alpha, y);
+            for(uint32_t x = 0; x < channels.width; ++x)
+            {
+                const float horizontal = static_cast<float>(x) / static_cast<float>(channels.width);
+                red[x] = horizontal;
+                green[x] = vertical;
+                blue[x] = shift;
+                alpha[x] = 1.0f;
+            }
+        }
+    }
+}
+
+Input Input::fromRawFile(std::string name, const std::string& path)
+{
+    auto file = std::make_shared<RawFrameFile>(path);
+    Input input(std::move(name), file->getWidth(), file->getHeight());
+    input.m_size = file->getFrameCount();
+    input.m_file = std::move(file);
+    return input;
+}
+void Input::writeTestFile(const std::string& path, uint32_t frame_count, uint32_t width, uint32_t height)
+{
+    // One frame in memory at a time, whatever the length of the file
+    Backend::Channels frame(width, height);
+    RawFrameFile::Writer writer(path, frame.width, frame.height, frame.stride);
+    for(uint32_t frame_number = 0; frame_number < frame_count; ++frame_number)
+    {
+        fillTestPattern(frame, frame_number);
+        writer.append(frame);
+    }
+    writer.finish();
+}
 std::optional<Image> Input::read()
 {
-    OPTICK_EVENT();
-    OPTICK_TAG("name", m_name.c_str());
+    TRACE_EVENT();
+    TRACE_TAG("name", m_name.c_str());
     if(m_frame_number >= m_size)
     {
         std::cout << "Read: " << m_name << "-EOF" << std::endl;
-        busyWait(durations::one_read_eof);
+        if(m_file == nullptr)
+        {
+            busyWait(durations::one_read_eof);
+        }
         return std::nullopt;
     }
-    const std::string image_name = m_name + "-" + std::to_string(m_frame_number++);
+    const uint32_t frame_number = m_frame_number++;
+    const std::string image_name = m_name + "-" + std::to_string(frame_number);
     std::cout << "Read: " << image_name << std::endl;
+    if(m_file != nullptr)
+    {
+        return Image{image_name, m_file->mapFrame(frame_number)};
+    }
     busyWait(durations::one_read);
-    return Image{image_name};
+    Image image = m_frame_pool != nullptr ? Image{image_name, m_frame_pool->createBackend(m_width, m_height)}
+                                          : Image{image_name, m_width, m_height};
+    fillTestPattern(image.getChannels(), frame_number);
+    return image;
 }
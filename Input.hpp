@@ -1,8 +1,18 @@
 #pragma once
 
 #include "Image.hpp"
+#include "FramePool.hpp"
+#include "AsyncGenerator.hpp"
+#include "RawFrameFile.hpp"
+#include "JobResult.hpp"
+#include "Metrics.hpp"
+#include "util.hpp"
+
+#include "Trace.hpp"
+#include <stdexec/execution.hpp>
 
 #include <atomic>
+#include <memory>
 #include <optional>
 #include <utility>
 
@@ -11,16 +21,57 @@ class Input
     public:
 
 
+        static constexpr const uint32_t DEFAULT_WIDTH = 640;
+        static constexpr const uint32_t DEFAULT_HEIGHT = 360;
+
         std::optional<Image> read();
+        // Frame stream, every frame is read on `scheduler` and up to DEPTH frames are read ahead of the consumer
+        template<uint32_t DEPTH = 2, stdexec::scheduler Scheduler>
+        static AsyncGenerator<Image, DEPTH> frames(Input input, Scheduler scheduler, std::shared_ptr<JobMetrics> metrics = nullptr,
+                                                   LatencyHistogram* read_latency = nullptr)
+        {
+            while(true)
+            {
+                co_await stdexec::schedule(scheduler);
+                TRACE_THREAD(g_thread_name.c_str());
+                std::optional<Image> image;
+                {
+                    JobMetrics::StageTimer timer(metrics.get(), JobStage::Read);
+                    LatencyHistogram::Timer latency_timer(read_latency);
+                    image = input.read();
+                }
+                if(!image)
+                {
+                    co_return;
+                }
+                if(metrics != nullptr)
+                {
+                    metrics->addRead(image->getChannels().byteSize());
+                }
+                co_yield std::move(*image);
+            }
+        }
+        // The frames are allocated from the pool instead of the heap when set
+        void setFramePool(std::shared_ptr<FramePool> frame_pool) { m_frame_pool = std::move(frame_pool); }
 
-        explicit Input(std::string name)
+        explicit Input(std::string name, uint32_t width = DEFAULT_WIDTH, uint32_t height = DEFAULT_HEIGHT)
             : m_name(std::move(name))
+            , m_width(width)
+            , m_height(height)
         {}
+        // Reads the frames of a raw frame file instead of generating them, the images reference the mapped file
+        static Input fromRawFile(std::string name, const std::string& path);
+        // Writes `frame_count` frames of the generated test pattern, a file to benchmark the pipeline with
+        static void writeTestFile(const std::string& path, uint32_t frame_count, uint32_t width = DEFAULT_WIDTH, uint32_t height = DEFAULT_HEIGHT);
 
         Input(Input&& o)
         : m_frame_number(o.m_frame_number.load())
         , m_size(std::exchange(o.m_size, 0))
         , m_name(std::exchange(o.m_name, ""))
+        , m_width(o.m_width)
+        , m_height(o.m_height)
+        , m_frame_pool(std::move(o.m_frame_pool))
+        , m_file(std::move(o.m_file))
         {
             o.m_frame_number = 0;
         }
@@ -28,4 +79,8 @@ class Input
         std::atomic_uint32_t m_frame_number{0};
         uint32_t m_size {6};
         std::string m_name;
+        uint32_t m_width {DEFAULT_WIDTH};
+        uint32_t m_height {DEFAULT_HEIGHT};
+        std::shared_ptr<FramePool> m_frame_pool;
+        std::shared_ptr<RawFrameFile> m_file;
 };
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <array>
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <utility>
+
+enum class JobPriority : uint8_t
+{
+    Background,
+    Normal,
+    Interactive,
+    Count
+};
+
+/*
+Limits the number of jobs running at once. co_await admit(priority) suspends the job while the limit is reached,
+release() (or destroying an AdmittedJob) admits the next pending job: the highest priority first, in arrival order
+within a priority.
+The admitted coroutine is resumed on the releasing thread. A limit of 0 admits every job immediately.
+A pending job whose stop token is triggered leaves the queue right away: co_await admit(...) returns false on the
+thread which requested the stop, and the job holds no slot.
+*/
+class JobAdmission
+{
+public:
+    struct Awaiter;
+    struct StopCallback
+    {
+        Awaiter* awaiter {nullptr};
+        void operator()() const noexcept { awaiter->admission->cancel(awaiter); }
+    };
+    struct [[nodiscard]] Awaiter
+    {
+        JobAdmission* admission {nullptr};
+        JobPriority priority {JobPriority::Normal};
+        std::stop_token stop_token;
+        std::coroutine_handle<> awaiting_coroutine = std::noop_coroutine();
+        Awaiter* next {nullptr};
+        // Guarded by the admission's mutex
+        bool queued {false};
+        bool admitted {false};
+        bool cancelled {false};
+        // Registered before the awaiter is queued, so a stop requested meanwhile is seen by suspendOrAdmit
+        std::optional<std::stop_callback<StopCallback>> stop_callback;
+        bool await_ready() { return false; }
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            awaiting_coroutine = handle;
+            stop_callback.emplace(stop_token, StopCallback{this});
+            return admission->suspendOrAdmit(this);
+        }
+        // False if the job was stopped before it was admitted, it must not release a slot then
+        [[nodiscard]] bool await_resume() const { return cancelled == false; }
+    };
+    // Releases the admitted job when it goes out of scope, whether the job completed, threw or was stopped
+    class [[nodiscard]] AdmittedJob
+    {
+    public:
+        explicit AdmittedJob(JobAdmission& admission)
+        : m_admission(&admission)
+        {}
+        ~AdmittedJob() { m_admission->release(); }
+        AdmittedJob(const AdmittedJob&) = delete;
+        AdmittedJob& operator=(const AdmittedJob&) = delete;
+    private:
+        JobAdmission* m_admission;
+    };
+
+    explicit JobAdmission(uint32_t max_running = 0)
+    : m_max_running(max_running)
+    {}
+    JobAdmission(const JobAdmission&) = delete;
+    JobAdmission& operator=(const JobAdmission&) = delete;
+
+    Awaiter admit(JobPriority priority = JobPriority::Normal, std::stop_token stop_token = {})
+    {
+        return Awaiter{this, priority, std::move(stop_token)};
+    }
+    // An admitted job finished
+    void release()
+    {
+        std::unique_lock lock(m_mutex);
+        --m_running;
+        resumeAdmittedLocked(std::move(lock));
+    }
+    // Raising the limit admits pending jobs right away, lowering it lets the running ones finish
+    void setMaxRunning(uint32_t max_running)
+    {
+        std::unique_lock lock(m_mutex);
+        m_max_running = max_running;
+        resumeAdmittedLocked(std::move(lock));
+    }
+    uint32_t getMaxRunning() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_max_running;
+    }
+    uint32_t running() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_running;
+    }
+    uint32_t pending() const
+    {
+        std::lock_guard lock(m_mutex);
+        return m_pending;
+    }
+private:
+    struct WaitList
+    {
+        Awaiter* head {nullptr};
+        Awaiter* tail {nullptr};
+    };
+
+    bool hasRoomLocked() const
+    {
+        return m_max_running == 0 || m_running < m_max_running;
+    }
+    // Returns false when the job is admitted and should not be suspended
+    bool suspendOrAdmit(Awaiter* awaiter)
+    {
+        std::lock_guard lock(m_mutex);
+        if(awaiter->cancelled)
+        {
+            return false;
+        }
+        if(m_pending == 0 && hasRoomLocked())
+        {
+            awaiter->admitted = true;
+            ++m_running;
+            return false;
+        }
+        WaitList& list = m_waiting[static_cast<uint32_t>(awaiter->priority)];
+        awaiter->next = nullptr;
+        if(list.tail == nullptr)
+        {
+            list.head = awaiter;
+        }
+        else
+        {
+            list.tail->next = awaiter;
+        }
+        list.tail = awaiter;
+        awaiter->queued = true;
+        ++m_pending;
+        return true;
+    }
+    // Called by the stop callback of a pending job, resumes it unless it was already admitted
+    void cancel(Awaiter* awaiter)
+    {
+        std::unique_lock lock(m_mutex);
+        if(awaiter->admitted)
+        {
+            return;
+        }
+        awaiter->cancelled = true;
+        if(awaiter->queued == false)
+        {
+            // Not queued yet, suspendOrAdmit sees the flag
+            return;
+        }
+        WaitList& list = m_waiting[static_cast<uint32_t>(awaiter->priority)];
+        Awaiter* previous = nullptr;
+        for(Awaiter* current = list.head; current != awaiter; current = current->next)
+        {
+            previous = current;
+        }
+        (previous == nullptr ? list.head : previous->next) = awaiter->next;
+        if(list.tail == awaiter)
+        {
+            list.tail = previous;
+        }
+        awaiter->next = nullptr;
+        awaiter->queued = false;
+        --m_pending;
+        lock.unlock();
+        // The resumed coroutine destroys the awaiter and its stop callback, which doesn't wait for us on this thread
+        awaiter->awaiting_coroutine.resume();
+    }
+    // The coroutines are resumed outside of the lock
+    void resumeAdmittedLocked(std::unique_lock<std::mutex> lock)
+    {
+        Awaiter* admitted = nullptr;
+        Awaiter** admitted_tail = &admitted;
+        for(uint32_t priority = static_cast<uint32_t>(JobPriority::Count); priority-- > 0;)
+        {
+            WaitList& list = m_waiting[priority];
+            while(list.head != nullptr && hasRoomLocked())
+            {
+                Awaiter* awaiter = std::exchange(list.head, list.head->next);
+                if(list.head == nullptr)
+                {
+                    list.tail = nullptr;
+                }
+                awaiter->next = nullptr;
+                awaiter->queued = false;
+                awaiter->admitted = true;
+                --m_pending;
+                ++m_running;
+                *admitted_tail = awaiter;
+                admitted_tail = &awaiter->next;
+            }
+        }
+        lock.unlock();
+        while(admitted != nullptr)
+        {
+            // The awaiter can be destroyed by the resumed coroutine
+            Awaiter* awaiter = std::exchange(admitted, admitted->next);
+            awaiter->awaiting_coroutine.resume();
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    uint32_t m_max_running {0};
+    uint32_t m_running {0};
+    uint32_t m_pending {0};
+    std::array<WaitList, static_cast<uint32_t>(JobPriority::Count)> m_waiting {};
+};
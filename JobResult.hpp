@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+
+#include <time.h>
+
+enum class JobStage : uint32_t
+{
+    Read,
+    Transform,
+    Write,
+    Count
+};
+
+// What a video job did, the completion callback of Context::spawn2 gets it
+struct JobResult
+{
+    struct StageTime
+    {
+        std::chrono::nanoseconds wall {0};
+        // CPU time of the threads which ran the stage, zero for the parts waiting on asynchronous I/O
+        std::chrono::nanoseconds cpu {0};
+    };
+    uint64_t frames_read {0};
+    uint64_t frames_written {0};
+    // Read but not written because the job was stopped or failed
+    uint64_t frames_dropped {0};
+    uint64_t bytes_in {0};
+    uint64_t bytes_out {0};
+    // Summed over the workers, the stages of several frames overlap so the sum can exceed the duration of the job
+    std::array<StageTime, static_cast<uint32_t>(JobStage::Count)> stages {};
+    std::chrono::nanoseconds duration {0};
+    bool stopped {false};
+    // The first error of the job, the rest of its frames were dropped
+    std::exception_ptr error;
+
+    const StageTime& stage(JobStage job_stage) const { return stages[static_cast<uint32_t>(job_stage)]; }
+};
+
+// Collects the JobResult of a running job, the stages update it concurrently
+class JobMetrics
+{
+public:
+    // Measures the wall and CPU time of the current thread, must not live across a co_await
+    class StageTimer
+    {
+    public:
+        StageTimer(JobMetrics* metrics, JobStage stage)
+        : m_metrics(metrics)
+        , m_stage(stage)
+        , m_wall_start(std::chrono::steady_clock::now())
+        , m_cpu_start(threadCpuTime())
+        {}
+        StageTimer(const StageTimer&) = delete;
+        StageTimer& operator=(const StageTimer&) = delete;
+        ~StageTimer()
+        {
+            if(m_metrics != nullptr)
+            {
+                m_metrics->addTime(m_stage, std::chrono::steady_clock::now() - m_wall_start, threadCpuTime() - m_cpu_start);
+            }
+        }
+    private:
+        JobMetrics* m_metrics {nullptr};
+        JobStage m_stage {JobStage::Read};
+        std::chrono::steady_clock::time_point m_wall_start;
+        std::chrono::nanoseconds m_cpu_start {0};
+    };
+
+    void addRead(uint64_t bytes)
+    {
+        m_frames_read.fetch_add(1, std::memory_order_relaxed);
+        m_bytes_in.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    void addWritten(uint64_t frames, uint64_t bytes)
+    {
+        m_frames_written.fetch_add(frames, std::memory_order_relaxed);
+        m_bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    void addDropped(uint64_t frames)
+    {
+        m_frames_dropped.fetch_add(frames, std::memory_order_relaxed);
+    }
+    void addTime(JobStage stage, std::chrono::nanoseconds wall, std::chrono::nanoseconds cpu = std::chrono::nanoseconds{0})
+    {
+        StageCounters& counters = m_stages[static_cast<uint32_t>(stage)];
+        counters.wall_ns.fetch_add(wall.count(), std::memory_order_relaxed);
+        counters.cpu_ns.fetch_add(cpu.count(), std::memory_order_relaxed);
+    }
+    // Only the first error is kept
+    void setError(std::exception_ptr error)
+    {
+        std::lock_guard lock(m_error_mutex);
+        if(!m_error)
+        {
+            m_error = std::move(error);
+        }
+    }
+    // Called once the job completed, the counters are not updated any more
+    JobResult result(bool stopped) const
+    {
+        JobResult result;
+        result.frames_read = m_frames_read.load(std::memory_order_relaxed);
+        result.frames_written = m_frames_written.load(std::memory_order_relaxed);
+        result.frames_dropped = m_frames_dropped.load(std::memory_order_relaxed);
+        result.bytes_in = m_bytes_in.load(std::memory_order_relaxed);
+        result.bytes_out = m_bytes_out.load(std::memory_order_relaxed);
+        for(uint32_t i = 0; i < result.stages.size(); ++i)
+        {
+            result.stages[i].wall = std::chrono::nanoseconds{m_stages[i].wall_ns.load(std::memory_order_relaxed)};
+            result.stages[i].cpu = std::chrono::nanoseconds{m_stages[i].cpu_ns.load(std::memory_order_relaxed)};
+        }
+        result.duration = std::chrono::steady_clock::now() - m_start;
+        result.stopped = stopped;
+        std::lock_guard lock(m_error_mutex);
+        result.error = m_error;
+        return result;
+    }
+
+    static std::chrono::nanoseconds threadCpuTime()
+    {
+        timespec time {};
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return std::chrono::seconds{time.tv_sec} + std::chrono::nanoseconds{time.tv_nsec};
+    }
+private:
+    struct StageCounters
+    {
+        std::atomic<int64_t> wall_ns {0};
+        std::atomic<int64_t> cpu_ns {0};
+    };
+
+    std::chrono::steady_clock::time_point m_start {std::chrono::steady_clock::now()};
+    std::atomic<uint64_t> m_frames_read {0};
+    std::atomic<uint64_t> m_frames_written {0};
+    std::atomic<uint64_t> m_frames_dropped {0};
+    std::atomic<uint64_t> m_bytes_in {0};
+    std::atomic<uint64_t> m_bytes_out {0};
+    std::array<StageCounters, static_cast<uint32_t>(JobStage::Count)> m_stages {};
+    mutable std::mutex m_error_mutex;
+    std::exception_ptr m_error;
+};
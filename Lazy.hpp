@@ -1,7 +1,29 @@
 #pragma once
 
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+
 #include <exec/task.hpp>
 
+/*
+Marks the current thread as a pool worker while the scope is alive. Blocking on a Lazy (operator*) inside
+such a scope is a bug: the worker sleeps in a nested sync_wait, checked by an assert in debug builds.
+The pools with their own worker loop (LibuvThreadPool, StreamAffinityPool) hold it for every task, on the
+other pools (tbb, static_thread_pool) Context holds it for every stage of a frame (FrameJob::runStage).
+*/
+class WorkerThreadScope
+{
+    public:
+        WorkerThreadScope() { ++s_depth; }
+        ~WorkerThreadScope() { --s_depth; }
+        WorkerThreadScope(const WorkerThreadScope&) = delete;
+        WorkerThreadScope& operator=(const WorkerThreadScope&) = delete;
+        static bool isActive() { return s_depth != 0; }
+    private:
+        static inline thread_local uint32_t s_depth {0};
+};
+
 template<typename T>
 class [[nodiscard]] Lazy: public exec::task<T>
 {
@@ -12,8 +34,32 @@ class [[nodiscard]] Lazy: public exec::task<T>
         Lazy(exec::task<T>&& o)
             : exec::task<T>(std::move(o))
         {}
+        // Blocks the calling thread, only for threads outside of the pools. On a worker co_await the Lazy instead.
         T operator*()
         {
+            assert(!WorkerThreadScope::isActive() && "Lazy::operator* would block a pool worker, co_await it instead");
             return stdexec::sync_wait(*this).value();
         }
-};
\ No newline at end of file
+        // The awaiting coroutine is resumed on `scheduler` instead of the thread which completed the Lazy (e.g. an I/O thread)
+        template<stdexec::scheduler Scheduler>
+        Lazy<T> continueOn(Scheduler scheduler) &&
+        {
+            return resumeOn(std::move(*this), std::move(scheduler));
+        }
+    private:
+        template<typename Scheduler>
+        static Lazy<T> resumeOn(Lazy<T> lazy, Scheduler scheduler)
+        {
+            if constexpr(std::is_void_v<T>)
+            {
+                co_await std::move(lazy);
+                co_await stdexec::schedule(scheduler);
+            }
+            else
+            {
+                T value = co_await std::move(lazy);
+                co_await stdexec::schedule(scheduler);
+                co_return value;
+            }
+        }
+};
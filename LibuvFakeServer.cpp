@@ -15,7 +15,7 @@ namespace
             return instance;
         }
         Globals()
-            : context(uv_default_loop())
+            : context(uv_default_loop(), LibuvSubmitMode::Batched)
             {}
 
         Context<LibuvThreadPool> context;
@@ -3,64 +3,286 @@
 
 #include <uv.h>
 
+#include "Lazy.hpp"
+
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 
+/*
+Recycles the libuv work requests so submitting a task does not allocate.
+Requests are taken on the submitting thread and given back when the task is done (on the loop thread in onDone
+or on the worker in batched mode), the pool only grows when more tasks are in flight than ever before.
+*/
+template<typename T>
+class WorkRequestPool
+{
+    static constexpr const uint32_t BLOCK_SIZE = 64;
+    public:
+        T* acquire()
+        {
+            std::lock_guard lock(m_mutex);
+            if(m_free == nullptr)
+            {
+                grow();
+            }
+            return std::exchange(m_free, m_free->next);
+        }
+        void release(T* request)
+        {
+            std::lock_guard lock(m_mutex);
+            request->next = std::exchange(m_free, request);
+        }
+    private:
+        void grow()
+        {
+            auto& block = m_blocks.emplace_back(std::make_unique<T[]>(BLOCK_SIZE));
+            for(uint32_t i = 0; i < BLOCK_SIZE; ++i)
+            {
+                block[i].next = std::exchange(m_free, &block[i]);
+            }
+        }
+        std::mutex m_mutex;
+        T* m_free {nullptr};
+        std::vector<std::unique_ptr<T[]>> m_blocks;
+};
+
+enum class LibuvSubmitMode
+{
+    // Every task is a separate uv_queue_work call with its own onDone on the loop thread
+    PerTask,
+    /*
+    Tasks are queued inside the arena and at most one libuv work item per worker drains them,
+    so uv_queue_work and the onDone round-trip through the loop is paid once per batch instead of once per task.
+    */
+    Batched
+};
+
 class LibuvTaskArena
 {
     struct WorkRequest
     {
-        template<typename U>
-            requires std::convertible_to<U, std::function<void()>>
-        WorkRequest(U&& callback)
-            : callback(std::forward<U>(callback))
+        // Has to be the first member, the libuv callbacks get back a pointer to it
+        uv_work_t request{};
+        tbbexec::_thpool::task_base* task {nullptr};
+        std::uint32_t tid {0};
+        // Links the free list of the pool or the pending queue in batched mode
+        WorkRequest* next {nullptr};
+    };
+    static_assert(std::is_standard_layout_v<WorkRequest>);
+    struct WorkQueue
+    {
+        WorkRequest* head {nullptr};
+        WorkRequest* tail {nullptr};
+        void push(WorkRequest* work_request)
+        {
+            work_request->next = nullptr;
+            if(tail == nullptr)
+            {
+                head = work_request;
+            }
+            else
+            {
+                tail->next = work_request;
+            }
+            tail = work_request;
+        }
+        WorkRequest* pop()
         {
-            request.data = this;
+            WorkRequest* work_request = head;
+            if(work_request != nullptr)
+            {
+                head = work_request->next;
+                if(head == nullptr)
+                {
+                    tail = nullptr;
+                }
+            }
+            return work_request;
         }
-        std::function<void()> callback;
+    };
+    struct Drainer
+    {
+        LibuvTaskArena* arena {nullptr};
+        uint32_t index {0};
+        // Guarded by m_pending_mutex
+        bool idle {true};
+    };
+    /*
+    A drainer goes idle on its worker, before libuv calls onDrainDone on the loop thread, so it can be submitted
+    again while the previous request is still owned by libuv: every submission takes its own request.
+    */
+    struct DrainRequest
+    {
+        // Has to be the first member, the libuv callbacks get back a pointer to it
         uv_work_t request{};
+        Drainer* drainer {nullptr};
+        DrainRequest* next {nullptr};
     };
+    static_assert(std::is_standard_layout_v<DrainRequest>);
     static void onWork(uv_work_t* request_ptr)
     {
-        auto* work_request = reinterpret_cast<WorkRequest*>(request_ptr->data);
-        work_request->callback();
+        WorkerThreadScope worker_scope;
+        auto* work_request = reinterpret_cast<WorkRequest*>(request_ptr);
+        // The task can be destroyed by its own execution, it must not be touched afterwards
+        work_request->task->__execute(work_request->task, /*tid=*/work_request->tid);
     }
     static void onDone(uv_work_t* request_ptr, int status)
     {
-        auto* work_request = reinterpret_cast<WorkRequest*>(request_ptr->data);
-        delete work_request;
+        auto* arena = reinterpret_cast<LibuvTaskArena*>(request_ptr->data);
+        arena->m_requests.release(reinterpret_cast<WorkRequest*>(request_ptr));
+    }
+    static void onDrain(uv_work_t* request_ptr)
+    {
+        WorkerThreadScope worker_scope;
+        Drainer* drainer = reinterpret_cast<DrainRequest*>(request_ptr)->drainer;
+        auto* arena = drainer->arena;
+        while(WorkRequest* work_request = arena->popPendingOrIdle(drainer))
+        {
+            auto* task = work_request->task;
+            const std::uint32_t tid = work_request->tid;
+            arena->m_requests.release(work_request);
+            task->__execute(task, /*tid=*/tid);
+        }
+    }
+    // Only recycles the request: the drainer doesn't depend on the loop running (it may have been stopped)
+    static void onDrainDone(uv_work_t* request_ptr, int status)
+    {
+        auto* drain_request = reinterpret_cast<DrainRequest*>(request_ptr);
+        drain_request->drainer->arena->m_drain_requests.release(drain_request);
     }
     public:
-        explicit LibuvTaskArena(uv_loop_t* main_loop)
+        explicit LibuvTaskArena(uv_loop_t* main_loop, LibuvSubmitMode mode = LibuvSubmitMode::PerTask)
         : m_main_loop(main_loop)
-        {}
+        , m_mode(mode)
+        , m_max_concurrency(readThreadCountFromEnv())
+        {
+            if(m_mode == LibuvSubmitMode::Batched)
+            {
+                m_drainers = std::make_unique<Drainer[]>(m_max_concurrency);
+                m_lanes = std::make_unique<WorkQueue[]>(m_max_concurrency);
+                for(uint32_t i = 0; i < m_max_concurrency; ++i)
+                {
+                    m_drainers[i].arena = this;
+                    m_drainers[i].index = i;
+                }
+                m_idle_count = m_max_concurrency;
+            }
+        }
         uint32_t getMaxConcurrency() const
         {
-            auto max_concurrency = readThreadCountFromEnv();
-            return max_concurrency.value_or(4);
+            return m_max_concurrency;
         }
-        template<typename T>
-        void enqueue(T&& callback)
+        void enqueue(tbbexec::_thpool::task_base* task, std::uint32_t tid)
         {
-            auto work_request = std::make_unique<WorkRequest>(std::forward<T>(callback));
-            uv_queue_work(m_main_loop, &work_request->request, onWork, onDone);
-            work_request.release();
+            WorkRequest* work_request = m_requests.acquire();
+            work_request->request.data = this;
+            work_request->task = task;
+            work_request->tid = tid;
+            if(m_mode == LibuvSubmitMode::PerTask)
+            {
+                uv_queue_work(m_main_loop, &work_request->request, onWork, onDone);
+                return;
+            }
+            if(Drainer* drainer = pushPending(work_request); drainer != nullptr)
+            {
+                submitDrainer(drainer);
+            }
         }
     private:
+    // libuv's defaults and limits for the size of its thread pool
+    static constexpr const uint32_t DEFAULT_THREADPOOL_SIZE = 4;
+    static constexpr const uint32_t MAX_THREADPOOL_SIZE = 1024;
+
+    /*
+    The task goes to the lane of the worker selected by its thread id, so the chunks of a bulk
+    operation (tid = 0..n-1) are spread between the workers instead of queueing up behind each other.
+    Returns an idle drainer which has to be submitted to pick up the task, preferably the owner of the lane.
+    */
+    Drainer* pushPending(WorkRequest* work_request)
+    {
+        const uint32_t lane = work_request->tid % m_max_concurrency;
+        std::lock_guard lock(m_pending_mutex);
+        m_lanes[lane].push(work_request);
+        ++m_pending_count;
+        if(m_idle_count == 0)
+        {
+            return nullptr;
+        }
+        for(uint32_t i = 0; i < m_max_concurrency; ++i)
+        {
+            Drainer& drainer = m_drainers[(lane + i) % m_max_concurrency];
+            if(drainer.idle)
+            {
+                drainer.idle = false;
+                --m_idle_count;
+                return &drainer;
+            }
+        }
+        return nullptr;
+    }
+    /*
+    Own lane first, steals from the others when it is empty. With nothing pending the drainer is marked idle under
+    the same lock, so pushPending either sees it busy before the pop or resubmits it afterwards.
+    */
+    WorkRequest* popPendingOrIdle(Drainer* drainer)
+    {
+        std::lock_guard lock(m_pending_mutex);
+        for(uint32_t i = 0; m_pending_count != 0 && i < m_max_concurrency; ++i)
+        {
+            if(WorkRequest* work_request = m_lanes[(drainer->index + i) % m_max_concurrency].pop(); work_request != nullptr)
+            {
+                --m_pending_count;
+                return work_request;
+            }
+        }
+        drainer->idle = true;
+        ++m_idle_count;
+        return nullptr;
+    }
+    void submitDrainer(Drainer* drainer)
+    {
+        DrainRequest* drain_request = m_drain_requests.acquire();
+        drain_request->drainer = drainer;
+        uv_queue_work(m_main_loop, &drain_request->request, onDrain, onDrainDone);
+    }
+
     uv_loop_t* m_main_loop {nullptr};
+    LibuvSubmitMode m_mode {LibuvSubmitMode::PerTask};
+    uint32_t m_max_concurrency {DEFAULT_THREADPOOL_SIZE};
+    WorkRequestPool<WorkRequest> m_requests;
+
+    std::mutex m_pending_mutex;
+    std::unique_ptr<WorkQueue[]> m_lanes;
+    uint32_t m_pending_count {0};
+    std::unique_ptr<Drainer[]> m_drainers;
+    uint32_t m_idle_count {0};
+    WorkRequestPool<DrainRequest> m_drain_requests;
 
-    std::optional<uint32_t> readThreadCountFromEnv() const
+    // Same default and limits as libuv's thread pool so the reported parallelism matches the real worker count
+    static uint32_t readThreadCountFromEnv()
     {
         const char* thread_count_str = std::getenv("UV_THREADPOOL_SIZE");
-        return thread_count_str == nullptr ? std::nullopt : std::optional<uint32_t>(std::atoi(thread_count_str));
+        if(thread_count_str == nullptr)
+        {
+            return DEFAULT_THREADPOOL_SIZE;
+        }
+        const long thread_count = std::atol(thread_count_str);
+        return static_cast<uint32_t>(std::clamp<long>(thread_count, 1, MAX_THREADPOOL_SIZE));
     }
 };
 
 class LibuvThreadPool : public tbbexec::_thpool::thread_pool_base<LibuvThreadPool> {
    public:
-    explicit LibuvThreadPool(uv_loop_t* main_loop)
-      : m_arena{main_loop} {
+    explicit LibuvThreadPool(uv_loop_t* main_loop, LibuvSubmitMode mode = LibuvSubmitMode::PerTask)
+      : m_arena{main_loop, mode} {
     }
 
     [[nodiscard]]
@@ -79,8 +301,8 @@ class LibuvThreadPool : public tbbexec::_thpool::thread_pool_base<LibuvThreadPoo
     friend struct tbbexec::_thpool::operation;
 
     void enqueue(tbbexec::_thpool::task_base* task, std::uint32_t tid = 0) noexcept {
-      m_arena.enqueue([task, tid] { task->__execute(task, /*tid=*/tid); });
-}
+      m_arena.enqueue(task, tid);
+    }
 
     LibuvTaskArena m_arena;
 };
\ No newline at end of file
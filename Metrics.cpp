@@ -0,0 +1,159 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+namespace
+{
+    void writeDuration(std::ostream& out, std::chrono::nanoseconds duration)
+    {
+        out << std::chrono::duration<double, std::micro>(duration).count();
+    }
+}
+
+const char* toString(MetricStage stage)
+{
+    switch(stage)
+    {
+        case MetricStage::Read: return "read";
+        case MetricStage::Colorize: return "colorize";
+        case MetricStage::Resize: return "resize";
+        case MetricStage::ManipulateAlpha: return "manipulate_alpha";
+        case MetricStage::Write: return "write";
+        case MetricStage::Count: break;
+    }
+    return "unknown";
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    // The buckets are read one by one, so the quantiles come from the bucket counts and not from m_count
+    std::array<uint64_t, BUCKET_COUNT> counts;
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    Snapshot snapshot;
+    snapshot.count = total;
+    if(total == 0)
+    {
+        return snapshot;
+    }
+    /*
+    record() counts the bucket before it updates m_min and m_max, a concurrent snapshot can still see them unset.
+    The first non-empty bucket gives the minimum then.
+    */
+    uint32_t first_bucket = 0;
+    while(counts[first_bucket] == 0)
+    {
+        ++first_bucket;
+    }
+    uint64_t min = m_min.load(std::memory_order_relaxed);
+    if(bucketIndex(min) > first_bucket)
+    {
+        min = bucketValue(first_bucket);
+    }
+    snapshot.min = std::chrono::nanoseconds{static_cast<int64_t>(min)};
+    snapshot.max = std::chrono::nanoseconds{static_cast<int64_t>(std::max(m_max.load(std::memory_order_relaxed), min))};
+    snapshot.mean = std::chrono::nanoseconds{m_sum.load(std::memory_order_relaxed) / std::max<uint64_t>(m_count.load(std::memory_order_relaxed), 1)};
+    const std::array<std::pair<double, std::chrono::nanoseconds*>, 4> quantiles = {{
+        {0.5, &snapshot.p50}, {0.9, &snapshot.p90}, {0.99, &snapshot.p99}, {0.999, &snapshot.p999}}};
+    uint64_t seen = 0;
+    uint32_t quantile = 0;
+    for(uint32_t i = 0; i < BUCKET_COUNT && quantile < quantiles.size(); ++i)
+    {
+        seen += counts[i];
+        while(quantile < quantiles.size() && seen >= static_cast<uint64_t>(quantiles[quantile].first * total + 0.5))
+        {
+            *quantiles[quantile].second = std::min(std::chrono::nanoseconds{bucketValue(i)}, snapshot.max);
+            ++quantile;
+        }
+    }
+    return snapshot;
+}
+
+std::string MetricsSnapshot::toText() const
+{
+    std::ostringstream out;
+    out << "streams: " << streams << " queued frames: " << queued_frames << " read ahead: " << read_ahead_frames
+        << " jobs running: " << running_jobs << " pending: " << pending_jobs;
+    if(pool_idle_time)
+    {
+        out << " pool idle: " << std::chrono::duration<double, std::milli>(*pool_idle_time).count() << "ms";
+    }
+    out << '\n';
+    for(uint32_t i = 0; i < stages.size(); ++i)
+    {
+        const LatencyHistogram::Snapshot& histogram = stages[i];
+        out << "  " << toString(static_cast<MetricStage>(i)) << ": count " << histogram.count << " (us) mean ";
+        writeDuration(out, histogram.mean);
+        out << " p50 ";
+        writeDuration(out, histogram.p50);
+        out << " p90 ";
+        writeDuration(out, histogram.p90);
+        out << " p99 ";
+        writeDuration(out, histogram.p99);
+        out << " p99.9 ";
+        writeDuration(out, histogram.p999);
+        out << " max ";
+        writeDuration(out, histogram.max);
+        out << '\n';
+    }
+    return out.str();
+}
+
+std::string MetricsSnapshot::toJson() const
+{
+    std::ostringstream out;
+    out << "{\"streams\":" << streams << ",\"queued_frames\":" << queued_frames << ",\"read_ahead_frames\":" << read_ahead_frames
+        << ",\"running_jobs\":" << running_jobs << ",\"pending_jobs\":" << pending_jobs;
+    if(pool_idle_time)
+    {
+        out << ",\"pool_idle_ms\":" << std::chrono::duration<double, std::milli>(*pool_idle_time).count();
+    }
+    out << ",\"stages_us\":{";
+    for(uint32_t i = 0; i < stages.size(); ++i)
+    {
+        const LatencyHistogram::Snapshot& histogram = stages[i];
+        out << (i == 0 ? "" : ",") << '"' << toString(static_cast<MetricStage>(i)) << "\":{\"count\":" << histogram.count;
+        const std::array<std::pair<const char*, std::chrono::nanoseconds>, 7> values = {{
+            {"min", histogram.min}, {"mean", histogram.mean}, {"p50", histogram.p50}, {"p90", histogram.p90},
+            {"p99", histogram.p99}, {"p999", histogram.p999}, {"max", histogram.max}}};
+        for(const auto& [name, value] : values)
+        {
+            out << ",\"" << name << "\":";
+            writeDuration(out, value);
+        }
+        out << '}';
+    }
+    out << "}}";
+    return out.str();
+}
+
+MetricsDumper::MetricsDumper(std::chrono::milliseconds interval, std::function<MetricsSnapshot()> source, MetricsFormat format, std::ostream& out)
+: m_interval(interval)
+, m_source(std::move(source))
+, m_format(format)
+, m_out(out)
+, m_thread([this] { run(); })
+{}
+MetricsDumper::~MetricsDumper()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+void MetricsDumper::run()
+{
+    std::unique_lock lock(m_mutex);
+    while(m_wake.wait_for(lock, m_interval, [this] { return m_stop; }) == false)
+    {
+        const MetricsSnapshot snapshot = m_source();
+        m_out << (m_format == MetricsFormat::Json ? snapshot.toJson() : snapshot.toText()) << std::endl;
+    }
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+
+enum class MetricStage : uint32_t
+{
+    Read,
+    Colorize,
+    Resize,
+    ManipulateAlpha,
+    Write,
+    Count
+};
+const char* toString(MetricStage stage);
+
+/*
+Always-on latency histogram with log-linear buckets (HdrHistogram style): every power of two is split into
+SUB_BUCKETS buckets, so a recorded value is off by at most 1/SUB_BUCKETS (~3%) from 1ns up to centuries.
+Recording is a few relaxed atomic increments, snapshots can be taken concurrently.
+*/
+class LatencyHistogram
+{
+public:
+    static constexpr const uint32_t SUB_BUCKET_BITS = 5;
+    static constexpr const uint32_t SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static constexpr const uint32_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    struct Snapshot
+    {
+        uint64_t count {0};
+        std::chrono::nanoseconds min {0};
+        std::chrono::nanoseconds max {0};
+        std::chrono::nanoseconds mean {0};
+        std::chrono::nanoseconds p50 {0};
+        std::chrono::nanoseconds p90 {0};
+        std::chrono::nanoseconds p99 {0};
+        std::chrono::nanoseconds p999 {0};
+    };
+    // Records the wall time until destroyed, does nothing without a histogram
+    class Timer
+    {
+    public:
+        explicit Timer(LatencyHistogram* histogram)
+        : m_histogram(histogram)
+        , m_start(histogram != nullptr ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{})
+        {}
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+        ~Timer()
+        {
+            if(m_histogram != nullptr)
+            {
+                m_histogram->record(std::chrono::steady_clock::now() - m_start);
+            }
+        }
+    private:
+        LatencyHistogram* m_histogram {nullptr};
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    void record(std::chrono::nanoseconds latency)
+    {
+        const uint64_t value = latency.count() > 0 ? static_cast<uint64_t>(latency.count()) : 0;
+        m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value, std::memory_order_relaxed);
+        uint64_t min = m_min.load(std::memory_order_relaxed);
+        while(value < min && m_min.compare_exchange_weak(min, value, std::memory_order_relaxed) == false)
+        {}
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while(value > max && m_max.compare_exchange_weak(max, value, std::memory_order_relaxed) == false)
+        {}
+    }
+    Snapshot snapshot() const;
+private:
+    static uint32_t bucketIndex(uint64_t value)
+    {
+        if(value < SUB_BUCKETS)
+        {
+            return static_cast<uint32_t>(value);
+        }
+        const uint32_t shift = static_cast<uint32_t>(std::bit_width(value)) - 1 - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<uint32_t>((value >> shift) - SUB_BUCKETS);
+    }
+    // The middle of the bucket
+    static uint64_t bucketValue(uint32_t index)
+    {
+        if(index < SUB_BUCKETS)
+        {
+            return index;
+        }
+        const uint32_t shift = index / SUB_BUCKETS - 1;
+        const uint64_t lowest = static_cast<uint64_t>(index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+        return lowest + ((uint64_t{1} << shift) >> 1);
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets {};
+    std::atomic<uint64_t> m_count {0};
+    std::atomic<uint64_t> m_sum {0};
+    std::atomic<uint64_t> m_min {std::numeric_limits<uint64_t>::max()};
+    std::atomic<uint64_t> m_max {0};
+};
+
+// The histograms of every stage of a context, shared by all of its jobs
+class PipelineMetrics
+{
+public:
+    LatencyHistogram& stage(MetricStage metric_stage) { return m_stages[static_cast<uint32_t>(metric_stage)]; }
+    const LatencyHistogram& stage(MetricStage metric_stage) const { return m_stages[static_cast<uint32_t>(metric_stage)]; }
+private:
+    std::array<LatencyHistogram, static_cast<uint32_t>(MetricStage::Count)> m_stages;
+};
+
+struct MetricsSnapshot
+{
+    std::array<LatencyHistogram::Snapshot, static_cast<uint32_t>(MetricStage::Count)> stages {};
+    uint32_t streams {0};
+    // Transformed or being transformed, not yet written (the depth of the QueueSchedulers)
+    uint32_t queued_frames {0};
+    // Read ahead by the inputs, waiting for a frame slot
+    uint32_t read_ahead_frames {0};
+    uint32_t running_jobs {0};
+    uint32_t pending_jobs {0};
+    // Summed over the workers, only for pools which measure it (StreamAffinityPool)
+    std::optional<std::chrono::nanoseconds> pool_idle_time;
+
+    const LatencyHistogram::Snapshot& stage(MetricStage metric_stage) const { return stages[static_cast<uint32_t>(metric_stage)]; }
+    std::string toText() const;
+    std::string toJson() const;
+};
+
+enum class MetricsFormat
+{
+    Text,
+    Json
+};
+
+// Writes a snapshot every `interval` on its own thread until destroyed
+class MetricsDumper
+{
+public:
+    MetricsDumper(std::chrono::milliseconds interval, std::function<MetricsSnapshot()> source, MetricsFormat format, std::ostream& out);
+    ~MetricsDumper();
+    MetricsDumper(const MetricsDumper&) = delete;
+    MetricsDumper& operator=(const MetricsDumper&) = delete;
+private:
+    void run();
+
+    std::chrono::milliseconds m_interval;
+    std::function<MetricsSnapshot()> m_source;
+    MetricsFormat m_format {MetricsFormat::Text};
+    std::ostream& m_out;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop {false};
+    std::thread m_thread;
+};
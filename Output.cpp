@@ -1,18 +1,47 @@
 #include "Output.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
-#include <optick.h>
+#include "Trace.hpp"
 
 #include <iostream>
 #include "util.hpp"
 #include "durations.hpp"
 
+Output Output::toRawFile(const std::string& path)
+{
+    Output output;
+    output.m_writer = std::make_shared<FrameWriter>(path);
+    return output;
+}
 void Output::write(const Image& image)
 {
-    OPTICK_EVENT();
-    OPTICK_TAG("Name", image.getName().c_str());
+    TRACE_EVENT();
+    TRACE_TAG("Name", image.getName().c_str());
     busyWait(durations::one_write);
     std::cout << "Write image: " << image.getName() << std::endl;
 }
+void Output::write(std::span<const Image> images)
+{
+    TRACE_EVENT();
+    TRACE_TAG("Frames", static_cast<uint32_t>(images.size()));
+    if(images.empty())
+    {
+        return;
+    }
+    // Only the setup is shared, the transfer takes as long as writing the frames one by one (one_write each)
+    std::size_t bytes = 0;
+    for(const Image& image : images)
+    {
+        bytes += image.getChannels().byteSize();
+    }
+    const std::size_t frame_bytes = std::max<std::size_t>(images.front().getChannels().byteSize(), 1);
+    const std::chrono::duration<double, std::milli> transfer = (durations::one_write - durations::write_setup) * (double(bytes) / frame_bytes);
+    busyWait(durations::write_setup + std::chrono::duration_cast<std::chrono::milliseconds>(transfer));
+    for(const Image& image : images)
+    {
+        std::cout << "Write image: " << image.getName() << std::endl;
+    }
+}
@@ -1,9 +1,25 @@
 #pragma once
 
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "FrameWriter.hpp"
 #include "Image.hpp"
 class Output
 {
     public:
+        Output() = default;
+        // The frames are written into a raw frame file (see RawFrameFile) through writeAsync
+        static Output toRawFile(const std::string& path);
+
         void write(const Image& image);
+        // Coalesced frames, written with one sequential write
+        void write(std::span<const Image> images);
+        bool isAsync() const { return m_writer != nullptr; }
+        // Only for async outputs, the frames of one call are submitted together
+        FrameWriter::Awaiter writeAsync(std::vector<Image> images) { return m_writer->write(std::move(images)); }
+    private:
+        std::shared_ptr<FrameWriter> m_writer;
 };
-
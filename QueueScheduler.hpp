@@ -3,45 +3,116 @@
 #include <chrono>
 #include <iostream>
 #include <thread>
-#include <shared_mutex>
-#include <list>
-#include <condition_variable>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
 
 #include <stdexec/execution.hpp>
 #include <exec/task.hpp>
 #include <exec/static_thread_pool.hpp>
 #include <exec/async_scope.hpp>
 
+#include "DeadlineTimer.hpp"
+
+enum class QueueOrder
+{
+    // Results are handed out in push order (e.g. video frames)
+    Strict,
+    // Results are handed out in completion order, useful for distributing work between several awaiters
+    Unordered
+};
+
+/*
+Collects the results of the pushed senders. Any number of coroutines can co_await the queue,
+each of them gets a different result. After close() and once every result is handed out
+the awaiters get a default constructed Res which marks the end of the stream.
+
+The results are stored in preallocated slots, at most `capacity` results can be pushed and not popped yet.
+In strict order the slots form a reorder ring: every push gets a sequence number and owns the slot
+`sequence % capacity` until the result is popped. The state of a slot is encoded in its own sequence
+counter (the same way as in Vyukov's bounded queue):
+ - sequence:                free, waiting for the result of the push with this sequence
+ - sequence + 1:            result is published
+ - sequence + capacity:     popped, free for the next round
+So completing a task is a slot write and an atomic publish, and checking readiness never touches the payload.
+In unordered mode the results are popped in completion order, so a slot is freed out of push order too:
+a push takes any free slot from the free slot ring and the popped slot goes back to it.
+*/
 template<typename Res>
 class QueueScheduler
 {
 public:
+    static constexpr const uint32_t DEFAULT_CAPACITY = 64;
 
-    struct Awaiter
+    struct [[nodiscard]] Awaiter
     {
         QueueScheduler* scheduler {nullptr};
         std::coroutine_handle<> awaiting_coroutine = std::noop_coroutine();
-        bool await_ready() { return scheduler->isReady(); }
-        void await_suspend(std::coroutine_handle<> handle)
+        std::optional<Res> result;
+        Awaiter* next {nullptr};
+        // Set by the timer of a TimedAwaiter, it gives up waiting
+        bool expired {false};
+        bool await_ready()
+        {
+            result = scheduler->tryPop();
+            return result.has_value();
+        }
+        bool await_suspend(std::coroutine_handle<> handle)
         {
             awaiting_coroutine = handle;
-            Awaiter* expected = nullptr;
-            const bool success = scheduler->m_awaiter.compare_exchange_strong(expected,
-                                                                              this,
-                                                                              std::memory_order_release,
-                                                                              std::memory_order_relaxed);
-            if(success == false)
-            {
-                throw std::runtime_error("Only one await is supported");
-            }
+            return scheduler->suspendOrPop(this);
         }
 
-        Res await_resume() { return scheduler->pop(); }
+        Res await_resume() { return std::move(*result); }
+    };
+    // Suspends until a result is ready or the deadline passes, on expiry it is resumed on the timer's thread
+    struct [[nodiscard]] TimedAwaiter : Awaiter
+    {
+        DeadlineTimer* timer {nullptr};
+        DeadlineTimer::Clock::time_point deadline;
+        DeadlineTimer::Handle timer_handle {};
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            this->awaiting_coroutine = handle;
+            // The awaiter lives until await_resume cancels the timer, so the callback can use it
+            timer_handle = timer->at(deadline, [this] { this->scheduler->expire(this); });
+            return this->scheduler->suspendOrPop(this);
+        }
+        // std::nullopt if the deadline passed first
+        std::optional<Res> await_resume()
+        {
+            timer->cancel(timer_handle);
+            return std::move(this->result);
+        }
     };
     using Result = Res;
-    QueueScheduler(exec::async_scope* scope)
-    : m_scope(scope)
-    {}
+    explicit QueueScheduler(exec::async_scope* scope, QueueOrder order = QueueOrder::Strict, uint32_t capacity = DEFAULT_CAPACITY)
+    : m_slots(std::make_unique<Slot[]>(capacity))
+    , m_completed(capacity)
+    , m_free(capacity)
+    , m_capacity(capacity)
+    , m_scope(scope)
+    , m_order(order)
+    {
+        if(capacity == 0)
+        {
+            throw std::invalid_argument("Queue capacity must be at least one");
+        }
+        for(uint32_t i = 0; i < capacity; ++i)
+        {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        if(m_order == QueueOrder::Unordered)
+        {
+            for(uint32_t i = 0; i < capacity; ++i)
+            {
+                m_free.push(i);
+            }
+        }
+    }
 
     ~QueueScheduler()
     {
@@ -55,74 +126,392 @@ public:
 
     void push(stdexec::sender auto&& task)
     {
-        using stdexec::let_value;
-        
-        auto skeleton_it = [this]
+        if(m_closed.load(std::memory_order_relaxed))
         {
-            auto lock = std::unique_lock(m_results_mutex);
-            return m_results.insert(m_results.end(), std::nullopt);
-        }();
-        auto set_skeleton = [this, skeleton_it](Res result) mutable 
+            throw std::runtime_error("Queue is closed, can't push");
+        }
+        const uint64_t ticket = reserve();
+        auto set_skeleton = [this, ticket](Res result)
         {
-            *skeleton_it = std::move(result);
-            if(isReady())
-            {
-                auto* awaiter = m_awaiter.exchange(nullptr, std::memory_order_acq_rel);
-                if(awaiter != nullptr)
-                {
-                    awaiter->awaiting_coroutine.resume();
-                }
-            }
+            publish(ticket, std::move(result));
         };
 
         m_scope->spawn( task | stdexec::then(set_skeleton));
     }
 
-    std::optional<Res> head() const
+    // No more push is allowed, the awaiters get the end of stream marker once the queue is drained
+    void close()
     {
-        std::shared_lock lock(m_results_mutex);
-        return m_results.empty() ? std::nullopt : m_results.front();
+        m_closed.store(true);
+        resumeAwaiters();
     }
 
     bool empty() const
     {
-        std::shared_lock lock(m_results_mutex);
-        return m_results.empty();
+        return size() == 0;
     }
     uint32_t size() const
     {
-        std::shared_lock lock(m_results_mutex);
-        return m_results.size();
+        return static_cast<uint32_t>(m_push_sequence.load(std::memory_order_acquire) - m_popped.load(std::memory_order_acquire));
+    }
+    uint32_t capacity() const
+    {
+        return m_capacity;
+    }
+    QueueOrder order() const
+    {
+        return m_order;
     }
 
-    Res pop()
+    Awaiter operator co_await()
+    {
+        return Awaiter{this};
+    }
+    // Non suspending pop: std::nullopt if the next result isn't ready yet, the end of stream marker once drained
+    std::optional<Res> tryTake()
+    {
+        return tryPop();
+    }
+    // Like co_await of the queue, but std::nullopt if no result was ready before `deadline`
+    TimedAwaiter takeUntil(DeadlineTimer::Clock::time_point deadline, DeadlineTimer& timer)
     {
-        auto lock = std::unique_lock(m_results_mutex);
-        if(m_results.empty())
+        return TimedAwaiter{{this}, &timer, deadline};
+    }
+
+    bool isReady() const
+    {
+        if(isDrained())
         {
-            throw std::runtime_error("Queue is emoty, can't pop");
+            return true;
         }
-        if(m_results.front().has_value() == false)
+        if(m_order == QueueOrder::Strict)
         {
-            throw std::runtime_error("Queue is not ready, can't pop");
+            const uint64_t sequence = m_pop_sequence.load(std::memory_order_acquire);
+            return getSlot(sequence).sequence.load(std::memory_order_acquire) == sequence + 1;
         }
-        auto result = std::move(*m_results.front());
-        m_results.pop_front();
-        return result;
+        return m_completed.empty() == false;
     }
-    Awaiter operator co_await()
+private:
+    struct alignas(64) Slot
     {
-        return Awaiter{this};
+        std::atomic<uint64_t> sequence {0};
+        std::optional<Res> value;
+    };
+
+    // Bounded multi-producer/multi-consumer queue of slot indices (Vyukov), the completed and the free slots in unordered mode
+    class IndexRing
+    {
+    public:
+        explicit IndexRing(uint32_t capacity)
+        : m_cells(std::make_unique<Cell[]>(capacity))
+        , m_capacity(capacity)
+        {
+            for(uint32_t i = 0; i < capacity; ++i)
+            {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+        void push(uint64_t value)
+        {
+            uint64_t position = m_enqueue_position.load(std::memory_order_relaxed);
+            while(true)
+            {
+                Cell& cell = m_cells[position % m_capacity];
+                const uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+                if(sequence == position)
+                {
+                    if(m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        cell.value = value;
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        return;
+                    }
+                }
+                else if(sequence < position)
+                {
+                    // Cannot happen, a slot index is in at most one ring at once so there are never more indices than cells
+                    throw std::runtime_error("Index ring overrun");
+                }
+                else
+                {
+                    position = m_enqueue_position.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        std::optional<uint64_t> tryPop()
+        {
+            uint64_t position = m_dequeue_position.load(std::memory_order_relaxed);
+            while(true)
+            {
+                Cell& cell = m_cells[position % m_capacity];
+                const uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+                if(sequence == position + 1)
+                {
+                    if(m_dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        const uint64_t value = cell.value;
+                        cell.sequence.store(position + m_capacity, std::memory_order_release);
+                        return value;
+                    }
+                }
+                else if(sequence < position + 1)
+                {
+                    return std::nullopt;
+                }
+                else
+                {
+                    position = m_dequeue_position.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        bool empty() const
+        {
+            const uint64_t position = m_dequeue_position.load(std::memory_order_relaxed);
+            return m_cells[position % m_capacity].sequence.load(std::memory_order_acquire) != position + 1;
+        }
+    private:
+        struct Cell
+        {
+            std::atomic<uint64_t> sequence {0};
+            uint64_t value {0};
+        };
+        std::unique_ptr<Cell[]> m_cells;
+        uint32_t m_capacity {0};
+        alignas(64) std::atomic<uint64_t> m_enqueue_position {0};
+        alignas(64) std::atomic<uint64_t> m_dequeue_position {0};
+    };
+
+    Slot& getSlot(uint64_t sequence) const
+    {
+        return m_slots[sequence % m_capacity];
+    }
+    // The sequence number in strict order, the index of the reserved slot in unordered mode
+    uint64_t reserve()
+    {
+        if(m_order == QueueOrder::Unordered)
+        {
+            const std::optional<uint64_t> slot = m_free.tryPop();
+            if(slot.has_value() == false)
+            {
+                throw std::runtime_error("Queue is full, can't push");
+            }
+            m_push_sequence.fetch_add(1, std::memory_order_acq_rel);
+            return *slot;
+        }
+        uint64_t sequence = m_push_sequence.load(std::memory_order_relaxed);
+        do
+        {
+            if(getSlot(sequence).sequence.load(std::memory_order_acquire) != sequence)
+            {
+                throw std::runtime_error("Queue is full, can't push");
+            }
+        } while(m_push_sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acq_rel) == false);
+        return sequence;
+    }
+    void publish(uint64_t ticket, Res result)
+    {
+        if(m_order == QueueOrder::Unordered)
+        {
+            m_slots[ticket].value = std::move(result);
+            m_completed.push(ticket);
+        }
+        else
+        {
+            Slot& slot = getSlot(ticket);
+            slot.value = std::move(result);
+            slot.sequence.store(ticket + 1, std::memory_order_release);
+        }
+        // Pairs with the fence in suspendOrPop, either the awaiter sees the result or we see the awaiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_awaiter_count.load(std::memory_order_relaxed) != 0)
+        {
+            resumeAwaiters();
+        }
     }
 
-    bool isReady() const
+    std::optional<Res> tryPop()
     {
-        return head() != std::nullopt;
+        std::optional<Res> result = m_order == QueueOrder::Strict ? tryPopInOrder() : tryPopCompleted();
+        if(result.has_value())
+        {
+            m_popped.fetch_add(1);
+            // The last result was taken, the other awaiters can be released with the end of stream marker
+            if(isDrained() && m_awaiter_count.load() != 0)
+            {
+                resumeAwaiters();
+            }
+            return result;
+        }
+        if(isDrained())
+        {
+            return Res{};
+        }
+        return std::nullopt;
     }
-private:
-    std::list<std::optional<Res>> m_results;
-    mutable std::shared_mutex m_results_mutex;
-    std::atomic<Awaiter*> m_awaiter {nullptr};
+    std::optional<Res> tryPopInOrder()
+    {
+        uint64_t sequence = m_pop_sequence.load(std::memory_order_relaxed);
+        while(true)
+        {
+            Slot& slot = getSlot(sequence);
+            if(slot.sequence.load(std::memory_order_acquire) != sequence + 1)
+            {
+                return std::nullopt;
+            }
+            if(m_pop_sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed))
+            {
+                return take(slot, sequence);
+            }
+        }
+    }
+    std::optional<Res> tryPopCompleted()
+    {
+        const std::optional<uint64_t> index = m_completed.tryPop();
+        if(index.has_value() == false)
+        {
+            return std::nullopt;
+        }
+        Slot& slot = m_slots[*index];
+        std::optional<Res> result = std::move(slot.value);
+        slot.value = std::nullopt;
+        m_free.push(*index);
+        return result;
+    }
+    std::optional<Res> take(Slot& slot, uint64_t sequence)
+    {
+        std::optional<Res> result = std::move(slot.value);
+        slot.value = std::nullopt;
+        slot.sequence.store(sequence + m_capacity, std::memory_order_release);
+        return result;
+    }
+    bool isDrained() const
+    {
+        return m_closed.load() && m_popped.load() == m_push_sequence.load();
+    }
+    // Returns false when the awaiter got a result (or expired) and should not be suspended
+    bool suspendOrPop(Awaiter* awaiter)
+    {
+        std::unique_lock lock(m_awaiters_mutex);
+        if(awaiter->expired)
+        {
+            return false;
+        }
+        awaiter->next = nullptr;
+        if(m_awaiters_tail == nullptr)
+        {
+            m_awaiters_head = awaiter;
+        }
+        else
+        {
+            m_awaiters_tail->next = awaiter;
+        }
+        m_awaiters_tail = awaiter;
+        m_awaiter_count.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        /*
+        A result could have been published between await_ready and the registration above:
+         - [ThreadA] queue.tryPop()? -> nothing
+         - [ThreadB] publish result & no awaiter to resume
+         - [ThreadA] register the awaiter (too late)
+        So after registering the awaiters get a second chance.
+        */
+        return resumeAwaitersLocked(std::move(lock), awaiter);
+    }
+    // Called by the timer of a TimedAwaiter, resumes it without a result unless it already got one
+    void expire(Awaiter* awaiter)
+    {
+        std::unique_lock lock(m_awaiters_mutex);
+        awaiter->expired = true;
+        Awaiter* previous = nullptr;
+        Awaiter** link = &m_awaiters_head;
+        while(*link != nullptr && *link != awaiter)
+        {
+            previous = *link;
+            link = &previous->next;
+        }
+        if(*link == nullptr)
+        {
+            // Got a result, or not registered yet: suspendOrPop sees the flag
+            return;
+        }
+        *link = awaiter->next;
+        if(m_awaiters_tail == awaiter)
+        {
+            m_awaiters_tail = previous;
+        }
+        awaiter->next = nullptr;
+        m_awaiter_count.fetch_sub(1, std::memory_order_relaxed);
+        lock.unlock();
+        awaiter->awaiting_coroutine.resume();
+    }
+    void resumeAwaiters()
+    {
+        resumeAwaitersLocked(std::unique_lock(m_awaiters_mutex), nullptr);
+    }
+    /*
+    Hands out the ready results to the waiting awaiters, the coroutines are resumed outside of the lock.
+    The `current` awaiter is not resumed, returns false instead if it got a result.
+    */
+    bool resumeAwaitersLocked(std::unique_lock<std::mutex> lock, Awaiter* current)
+    {
+        Awaiter* resumable = nullptr;
+        Awaiter** resumable_tail = &resumable;
+        bool current_suspended = true;
+        while(m_awaiters_head != nullptr)
+        {
+            auto result = m_order == QueueOrder::Strict ? tryPopInOrder() : tryPopCompleted();
+            if(result.has_value() == false)
+            {
+                if(isDrained() == false)
+                {
+                    break;
+                }
+                result = Res{};
+            }
+            else
+            {
+                m_popped.fetch_add(1);
+            }
+            Awaiter* awaiter = std::exchange(m_awaiters_head, m_awaiters_head->next);
+            m_awaiter_count.fetch_sub(1, std::memory_order_relaxed);
+            awaiter->result = std::move(result);
+            awaiter->next = nullptr;
+            if(awaiter == current)
+            {
+                current_suspended = false;
+                continue;
+            }
+            *resumable_tail = awaiter;
+            resumable_tail = &awaiter->next;
+        }
+        if(m_awaiters_head == nullptr)
+        {
+            m_awaiters_tail = nullptr;
+        }
+        lock.unlock();
+        while(resumable != nullptr)
+        {
+            // The awaiter can be destroyed by the resumed coroutine
+            Awaiter* awaiter = std::exchange(resumable, resumable->next);
+            awaiter->awaiting_coroutine.resume();
+        }
+        return current_suspended;
+    }
+
+    std::unique_ptr<Slot[]> m_slots;
+    IndexRing m_completed;
+    IndexRing m_free;
+    uint32_t m_capacity {0};
+    alignas(64) std::atomic<uint64_t> m_push_sequence {0};
+    alignas(64) std::atomic<uint64_t> m_pop_sequence {0};
+    alignas(64) std::atomic<uint64_t> m_popped {0};
+    std::atomic_bool m_closed {false};
+
+    std::mutex m_awaiters_mutex;
+    Awaiter* m_awaiters_head {nullptr};
+    Awaiter* m_awaiters_tail {nullptr};
+    std::atomic<uint32_t> m_awaiter_count {0};
 
     exec::async_scope* m_scope{nullptr};
-};
\ No newline at end of file
+    QueueOrder m_order {QueueOrder::Strict};
+};
@@ -0,0 +1,235 @@
+#include "RawFrameFile.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Trace.hpp"
+
+namespace
+{
+    std::system_error systemError(const std::string& what)
+    {
+        return std::system_error(errno, std::generic_category(), what);
+    }
+    std::size_t planeSamples(uint32_t stride, uint32_t height)
+    {
+        return std::size_t{stride} * height;
+    }
+    std::size_t pageSize()
+    {
+        static const std::size_t page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        return page_size;
+    }
+    // False if the product doesn't fit in a size_t, the sizes of a crafted header could wrap around
+    bool checkedProduct(std::initializer_list<std::size_t> factors, std::size_t& product)
+    {
+        product = 1;
+        for(const std::size_t factor : factors)
+        {
+            if(__builtin_mul_overflow(product, factor, &product))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+RawFrameFile::RawFrameFile(const std::string& path)
+{
+    TRACE_EVENT();
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        throw systemError("Can't open raw frame file " + path);
+    }
+    struct stat status {};
+    if(::fstat(fd, &status) != 0)
+    {
+        const std::system_error error = systemError("Can't stat raw frame file " + path);
+        ::close(fd);
+        throw error;
+    }
+    m_mapping_size = static_cast<std::size_t>(status.st_size);
+    if(m_mapping_size < sizeof(Header))
+    {
+        ::close(fd);
+        throw std::runtime_error("Raw frame file is too small: " + path);
+    }
+    // Private and writable, the pipeline transforms the frames in place without touching the file
+    void* mapping = ::mmap(nullptr, m_mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED)
+    {
+        throw systemError("Can't map raw frame file " + path);
+    }
+    m_mapping = static_cast<uint8_t*>(mapping);
+    ::madvise(m_mapping, m_mapping_size, MADV_SEQUENTIAL);
+
+    std::memcpy(&m_header, m_mapping, sizeof(Header));
+    // Checked before frameBytes() is used, the frames have to fit in the file
+    std::size_t frames_size = 0;
+    const bool valid = std::memcmp(m_header.magic, MAGIC, sizeof(MAGIC)) == 0
+                    && m_header.stride >= m_header.width
+                    && m_header.stride % PlanarChannels::ROW_ALIGNMENT == 0
+                    && checkedProduct({m_header.stride, m_header.height, PlanarChannels::Count, sizeof(float), m_header.frame_count}, frames_size)
+                    && frames_size <= m_mapping_size - sizeof(Header);
+    if(valid == false)
+    {
+        ::munmap(m_mapping, m_mapping_size);
+        throw std::runtime_error("Invalid raw frame file: " + path);
+    }
+    m_released.assign(m_header.frame_count, true);
+    prefetch(0, READ_AHEAD_FRAMES);
+}
+RawFrameFile::~RawFrameFile()
+{
+    ::munmap(m_mapping, m_mapping_size);
+}
+PlanarChannels RawFrameFile::mapFrame(uint32_t index)
+{
+    TRACE_EVENT();
+    if(index >= m_header.frame_count)
+    {
+        throw std::out_of_range("Frame index is out of the file");
+    }
+    prefetch(index + 1, READ_AHEAD_FRAMES);
+    PlanarChannels channels;
+    channels.width = m_header.width;
+    channels.height = m_header.height;
+    channels.stride = m_header.stride;
+    const std::size_t samples = planeSamples(m_header.stride, m_header.height);
+    float* frame = reinterpret_cast<float*>(m_mapping + sizeof(Header) + frameBytes() * index);
+    {
+        std::lock_guard lock(m_released_mutex);
+        m_released[index] = false;
+    }
+    // Shared by the four planes, the last one released drops the pages of the frame
+    const std::shared_ptr<const void> owner(frame, [file = shared_from_this(), index](const void*) { file->releaseFrame(index); });
+    for(uint32_t channel = 0; channel < PlanarChannels::Count; ++channel)
+    {
+        channels.planes[channel] = AlignedPlane(frame + samples * channel, samples, owner);
+    }
+    return channels;
+}
+RawFrameFile::Writer::Writer(const std::string& path, uint32_t width, uint32_t height, uint32_t stride)
+: m_path(path)
+, m_file(path, std::ios::binary | std::ios::trunc)
+{
+    std::memcpy(m_header.magic, MAGIC, sizeof(MAGIC));
+    m_header.width = width;
+    m_header.height = height;
+    m_header.stride = stride;
+    m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+    if(!m_file)
+    {
+        throw std::runtime_error("Can't write raw frame file " + m_path);
+    }
+}
+void RawFrameFile::Writer::append(const PlanarChannels& frame)
+{
+    if(frame.width != m_header.width || frame.height != m_header.height || frame.stride != m_header.stride)
+    {
+        throw std::invalid_argument("The frames of a raw frame file have to be the same size");
+    }
+    for(const AlignedPlane& plane : frame.planes)
+    {
+        m_file.write(reinterpret_cast<const char*>(plane.data()), static_cast<std::streamsize>(plane.size() * sizeof(float)));
+    }
+    if(!m_file)
+    {
+        throw std::runtime_error("Can't write raw frame file " + m_path);
+    }
+    ++m_header.frame_count;
+}
+void RawFrameFile::Writer::finish()
+{
+    m_file.seekp(0);
+    m_file.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+    m_file.close();
+    if(!m_file)
+    {
+        throw std::runtime_error("Can't write raw frame file " + m_path);
+    }
+}
+void RawFrameFile::write(const std::string& path, std::span<const PlanarChannels> frames)
+{
+    TRACE_EVENT();
+    Writer writer(path, frames.empty() ? 0 : frames.front().width, frames.empty() ? 0 : frames.front().height,
+                  frames.empty() ? 0 : frames.front().stride);
+    for(const PlanarChannels& frame : frames)
+    {
+        writer.append(frame);
+    }
+    writer.finish();
+}
+std::size_t RawFrameFile::frameBytes() const
+{
+    return planeSamples(m_header.stride, m_header.height) * PlanarChannels::Count * sizeof(float);
+}
+void RawFrameFile::prefetch(uint32_t first_frame, uint32_t frame_count) const
+{
+    const uint32_t end_frame = std::min(m_header.frame_count, first_frame + frame_count);
+    if(first_frame >= end_frame)
+    {
+        return;
+    }
+    // madvise needs a page aligned address
+    const std::size_t page_size = pageSize();
+    const std::size_t begin = (sizeof(Header) + frameBytes() * first_frame) / page_size * page_size;
+    const std::size_t end = std::min(m_mapping_size, sizeof(Header) + frameBytes() * end_frame);
+    ::madvise(m_mapping + begin, end - begin, MADV_WILLNEED);
+}
+void RawFrameFile::releaseFrame(uint32_t index)
+{
+    std::lock_guard lock(m_released_mutex);
+    m_released[index] = true;
+    // The pages entirely in the frame, plus the ones shared with neighbours which are released too
+    const std::size_t page_size = pageSize();
+    const std::size_t begin = sizeof(Header) + frameBytes() * index;
+    std::size_t first_page = begin / page_size;
+    std::size_t end_page = (begin + frameBytes() + page_size - 1) / page_size;
+    if(pageReleased(first_page) == false)
+    {
+        ++first_page;
+    }
+    if(end_page > first_page && pageReleased(end_page - 1) == false)
+    {
+        --end_page;
+    }
+    if(end_page > first_page)
+    {
+        // Drops the private copies of the written pages too, a later mapFrame reads the file again
+        ::madvise(m_mapping + first_page * page_size, std::min(end_page * page_size, m_mapping_size) - first_page * page_size, MADV_DONTNEED);
+    }
+}
+bool RawFrameFile::pageReleased(std::size_t page) const
+{
+    const std::size_t page_size = pageSize();
+    const std::size_t begin = std::max(page * page_size, sizeof(Header));
+    const std::size_t end = std::min((page + 1) * page_size, sizeof(Header) + frameBytes() * m_header.frame_count);
+    if(begin >= end)
+    {
+        // Only the header or the bytes after the last frame
+        return true;
+    }
+    const std::size_t last_frame = (end - 1 - sizeof(Header)) / frameBytes();
+    for(std::size_t frame = (begin - sizeof(Header)) / frameBytes(); frame <= last_frame; ++frame)
+    {
+        if(m_released[frame] == false)
+        {
+            return false;
+        }
+    }
+    return true;
+}
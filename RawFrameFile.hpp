@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Channels.hpp"
+
+/*
+Raw frame container: a 64 byte header followed by frame_count frames of identical size. A frame is the four planes of
+PlanarChannels in channel order, with the same padded row stride, so the mapped pages can be used as the planes directly.
+The file is mapped privately and writable: the frames alias the page cache until a stage writes them, then the kernel
+copies only the touched pages. Those copies stay resident until dropped, so the pages of a frame are dropped
+(MADV_DONTNEED) once its planes are released, keeping the resident size bounded by the frames in flight.
+*/
+class RawFrameFile : public std::enable_shared_from_this<RawFrameFile>
+{
+public:
+    struct Header
+    {
+        char magic[8];
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        uint32_t frame_count;
+        uint8_t reserved[40];
+    };
+    static_assert(sizeof(Header) == AlignedPlane::ALIGNMENT);
+    static constexpr const char MAGIC[8] = {'S', 'B', 'X', 'R', 'A', 'W', '0', '1'};
+    // Frames advised ahead of the last mapped one
+    static constexpr const uint32_t READ_AHEAD_FRAMES = 2;
+
+    // Has to be owned by a shared_ptr, the mapped frames keep the file mapped
+    explicit RawFrameFile(const std::string& path);
+    ~RawFrameFile();
+    RawFrameFile(const RawFrameFile&) = delete;
+    RawFrameFile& operator=(const RawFrameFile&) = delete;
+
+    uint32_t getWidth() const { return m_header.width; }
+    uint32_t getHeight() const { return m_header.height; }
+    uint32_t getFrameCount() const { return m_header.frame_count; }
+    // The planes reference the mapping, the following frames are prefetched
+    PlanarChannels mapFrame(uint32_t index);
+
+    // Streams the frames into a new file, so a long file doesn't have to fit in memory
+    class Writer
+    {
+    public:
+        Writer(const std::string& path, uint32_t width, uint32_t height, uint32_t stride);
+        void append(const PlanarChannels& frame);
+        // Writes the frame count into the header, the file holds no frame until then
+        void finish();
+    private:
+        std::string m_path;
+        std::ofstream m_file;
+        Header m_header {};
+    };
+    static void write(const std::string& path, std::span<const PlanarChannels> frames);
+private:
+    std::size_t frameBytes() const;
+    void prefetch(uint32_t first_frame, uint32_t frame_count) const;
+    // Called when the last plane of the frame is released
+    void releaseFrame(uint32_t index);
+    // No frame using the page is mapped anymore
+    bool pageReleased(std::size_t page) const;
+
+    Header m_header {};
+    uint8_t* m_mapping {nullptr};
+    std::size_t m_mapping_size {0};
+    std::mutex m_released_mutex;
+    // Guarded by m_released_mutex, a page shared by two frames is dropped once both are released
+    std::vector<bool> m_released;
+};
@@ -0,0 +1,221 @@
+#pragma once
+#include <tbbexec/tbb_thread_pool.hpp>
+
+#include "Lazy.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+enum class StreamPriority : uint8_t
+{
+    // Transforms and everything else which is throughput bound
+    Bulk,
+    // Runs before the bulk tasks of every worker, for the write stages of latency sensitive streams
+    Latency,
+    Count
+};
+
+/*
+Scheduling hint of the tasks enqueued from the current thread. Context sets it before it launches a stage of a stream,
+StreamAffinityPool sets it to the hint of the task it runs, so the continuations inherit it. Other pools ignore it.
+*/
+struct StreamAffinity
+{
+    static constexpr const uint32_t ANY_WORKER = std::numeric_limits<uint32_t>::max();
+    uint32_t worker {ANY_WORKER};
+    StreamPriority priority {StreamPriority::Bulk};
+
+    static StreamAffinity& current()
+    {
+        thread_local StreamAffinity affinity;
+        return affinity;
+    }
+};
+
+/*
+Sets the hint of the current thread and restores the previous one, so the code which resumed a stage doesn't
+enqueue its own tasks with the stage's hint. It must not live across a co_await, the thread could change.
+*/
+class StreamAffinityScope
+{
+    public:
+        explicit StreamAffinityScope(StreamAffinity affinity)
+            : m_previous(std::exchange(StreamAffinity::current(), affinity))
+        {}
+        ~StreamAffinityScope() { StreamAffinity::current() = m_previous; }
+        StreamAffinityScope(const StreamAffinityScope&) = delete;
+        StreamAffinityScope& operator=(const StreamAffinityScope&) = delete;
+    private:
+        StreamAffinity m_previous;
+};
+
+/*
+Thread pool with a queue per worker, usable as Context<StreamAffinityPool>.
+A task goes to the queue of its stream's preferred worker (or of the enqueuing worker when it has no preference),
+so the stages of a frame stay on the same core while that core keeps up. Idle workers steal from the others.
+Latency tasks are taken before bulk ones everywhere, they don't interrupt a running task.
+*/
+class StreamAffinityPool : public tbbexec::_thpool::thread_pool_base<StreamAffinityPool>
+{
+    struct Entry
+    {
+        tbbexec::_thpool::task_base* task {nullptr};
+        std::uint32_t tid {0};
+        StreamAffinity affinity {};
+    };
+    struct alignas(64) Worker
+    {
+        std::mutex mutex;
+        std::deque<Entry> queues[static_cast<uint32_t>(StreamPriority::Count)];
+        std::condition_variable wake;
+        // Guarded by m_sleep_mutex
+        bool sleeping {false};
+    };
+   public:
+    explicit StreamAffinityPool(uint32_t thread_count = std::thread::hardware_concurrency())
+      : m_worker_count(std::max(thread_count, 1u))
+      , m_workers(std::make_unique<Worker[]>(m_worker_count)) {
+        m_threads.reserve(m_worker_count);
+        for(uint32_t i = 0; i < m_worker_count; ++i)
+        {
+            m_threads.emplace_back([this, i] { run(i); });
+        }
+    }
+    ~StreamAffinityPool() {
+        {
+            std::lock_guard lock(m_sleep_mutex);
+            m_stop = true;
+            for(uint32_t i = 0; i < m_worker_count; ++i)
+            {
+                m_workers[i].sleeping = false;
+                m_workers[i].wake.notify_one();
+            }
+        }
+        for(std::thread& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    [[nodiscard]]
+    auto available_parallelism() const -> std::uint32_t {
+      return m_worker_count;
+    }
+    // Time the workers spent waiting for tasks, summed over the workers
+    std::chrono::nanoseconds idleTime() const {
+      return std::chrono::nanoseconds{m_idle_ns.load(std::memory_order_relaxed)};
+    }
+   private:
+    [[nodiscard]]
+    static constexpr auto forward_progress_guarantee() -> stdexec::forward_progress_guarantee {
+      return stdexec::forward_progress_guarantee::parallel;
+    }
+
+    friend tbbexec::_thpool::thread_pool_base<StreamAffinityPool>;
+
+    template <class PoolType, class ReceiverId>
+    friend struct tbbexec::_thpool::operation;
+
+    void enqueue(tbbexec::_thpool::task_base* task, std::uint32_t tid = 0) noexcept {
+        const StreamAffinity affinity = StreamAffinity::current();
+        uint32_t base = affinity.worker;
+        if(base == StreamAffinity::ANY_WORKER)
+        {
+            base = t_pool == this ? t_worker : m_next_worker.fetch_add(1, std::memory_order_relaxed);
+        }
+        // The chunks of a bulk operation (tid = 0..n-1) start at the preferred worker and spread over the next ones
+        const uint32_t index = (base + tid) % m_worker_count;
+        // Counted before it is published, a worker may take it right away and the decrement must not wrap around
+        m_pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard lock(m_workers[index].mutex);
+            m_workers[index].queues[static_cast<uint32_t>(affinity.priority)].push_back(Entry{task, tid, affinity});
+        }
+        std::lock_guard lock(m_sleep_mutex);
+        // The owner picks it up if it sleeps, otherwise an idle worker steals it
+        for(uint32_t i = 0; i < m_worker_count; ++i)
+        {
+            Worker& worker = m_workers[(index + i) % m_worker_count];
+            if(worker.sleeping)
+            {
+                worker.sleeping = false;
+                worker.wake.notify_one();
+                return;
+            }
+        }
+    }
+    void run(uint32_t index)
+    {
+        t_pool = this;
+        t_worker = index;
+        while(true)
+        {
+            if(std::optional<Entry> entry = take(index))
+            {
+                WorkerThreadScope worker_scope;
+                StreamAffinity::current() = entry->affinity;
+                // The task can be destroyed by its own execution, it must not be touched afterwards
+                entry->task->__execute(entry->task, /*tid=*/entry->tid);
+                continue;
+            }
+            std::unique_lock lock(m_sleep_mutex);
+            if(m_pending.load(std::memory_order_relaxed) != 0)
+            {
+                continue;
+            }
+            if(m_stop)
+            {
+                return;
+            }
+            Worker& worker = m_workers[index];
+            worker.sleeping = true;
+            const auto idle_start = std::chrono::steady_clock::now();
+            worker.wake.wait(lock, [&worker] { return worker.sleeping == false; });
+            m_idle_ns.fetch_add((std::chrono::steady_clock::now() - idle_start).count(), std::memory_order_relaxed);
+        }
+    }
+    // Latency tasks of all the queues first, then the bulk ones, each time the own queue before the others
+    std::optional<Entry> take(uint32_t index)
+    {
+        for(uint32_t priority = static_cast<uint32_t>(StreamPriority::Count); priority-- > 0;)
+        {
+            for(uint32_t i = 0; i < m_worker_count; ++i)
+            {
+                Worker& worker = m_workers[(index + i) % m_worker_count];
+                std::lock_guard lock(worker.mutex);
+                std::deque<Entry>& queue = worker.queues[priority];
+                if(queue.empty() == false)
+                {
+                    Entry entry = queue.front();
+                    queue.pop_front();
+                    m_pending.fetch_sub(1, std::memory_order_relaxed);
+                    return entry;
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    inline static thread_local const StreamAffinityPool* t_pool {nullptr};
+    inline static thread_local uint32_t t_worker {0};
+
+    uint32_t m_worker_count {1};
+    std::unique_ptr<Worker[]> m_workers;
+    std::vector<std::thread> m_threads;
+    std::atomic<uint32_t> m_next_worker {0};
+    std::mutex m_sleep_mutex;
+    std::atomic<uint32_t> m_pending {0};
+    bool m_stop {false};
+    std::atomic<int64_t> m_idle_ns {0};
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+Instrumentation macros, the backend is selected at compile time:
+  SANDBOX_TRACE_CHROME  ChromeTrace, per-thread ring buffers saved as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+  SANDBOX_TRACE_NONE    compiles to nothing
+  otherwise             Optick
+TRACE_EVENT() or TRACE_EVENT("name") traces the enclosing scope, TRACE_TAG(key, value) tags the event of the
+enclosing scope and has to follow a TRACE_EVENT. In a coroutine, where the scope spans co_awaits, use
+TRACE_ASYNC_EVENT instead (same arguments). TRACE_SAVE_CAPTURE appends the extension of the backend.
+*/
+#if defined(SANDBOX_TRACE_CHROME)
+
+#include "ChromeTrace.hpp"
+
+#define TRACE_EVENT(...) ::ChromeTrace::Scope trace_scope(::ChromeTrace::eventName(__PRETTY_FUNCTION__ __VA_OPT__(,) __VA_ARGS__))
+#define TRACE_ASYNC_EVENT(...) ::ChromeTrace::Scope trace_scope(::ChromeTrace::eventName(__PRETTY_FUNCTION__ __VA_OPT__(,) __VA_ARGS__), true)
+#define TRACE_TAG(key, value) trace_scope.tag(key, value)
+#define TRACE_THREAD(name) ::ChromeTrace::setThreadName(name)
+#define TRACE_FRAME(name) TRACE_EVENT(name)
+#define TRACE_START_CAPTURE() ::ChromeTrace::start()
+#define TRACE_STOP_CAPTURE() ::ChromeTrace::stop()
+#define TRACE_SAVE_CAPTURE(base_name) ::ChromeTrace::save(base_name ".json")
+
+#elif defined(SANDBOX_TRACE_NONE)
+
+#define TRACE_EVENT(...) ((void)0)
+#define TRACE_ASYNC_EVENT(...) ((void)0)
+#define TRACE_TAG(key, value) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#define TRACE_FRAME(name) ((void)0)
+#define TRACE_START_CAPTURE() ((void)0)
+#define TRACE_STOP_CAPTURE() ((void)0)
+#define TRACE_SAVE_CAPTURE(base_name) ((void)0)
+
+#else
+
+#include <optick.h>
+
+#define TRACE_EVENT(...) OPTICK_EVENT(__VA_ARGS__)
+#define TRACE_ASYNC_EVENT(...) OPTICK_EVENT(__VA_ARGS__)
+#define TRACE_TAG(key, value) OPTICK_TAG(key, value)
+#define TRACE_THREAD(name) OPTICK_THREAD(name)
+#define TRACE_FRAME(name) OPTICK_FRAME(name)
+#define TRACE_START_CAPTURE() OPTICK_START_CAPTURE()
+#define TRACE_STOP_CAPTURE() OPTICK_STOP_CAPTURE()
+#define TRACE_SAVE_CAPTURE(base_name) OPTICK_SAVE_CAPTURE(base_name ".opt")
+
+#endif
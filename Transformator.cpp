@@ -1,29 +1,30 @@
 #include "Transformator.hpp"
 
-#include <optick.h>
+#include "Trace.hpp"
 
-Image Transform::transform(const Image& image) const
+Image Transform::transform(Image image) const
 {
-    OPTICK_EVENT();
-    Image result = image;
-    result.colorize();
-    result.resize();
-    return result;
+    TRACE_EVENT();
+    image.colorize();
+    image.resize();
+    return image;
 }
 
-Image Transform::transform_upper(Image image) const
+void Transform::transform_upper(Image& image, uint32_t tile, uint32_t tile_count) const
 {
-    image.colorize();
-    return image;
+    TRACE_EVENT();
+    image.colorizeTile(tile, 2 * tile_count);
 }
 
-Image Transform::transform_lower(Image image) const
+void Transform::transform_lower(Image& image, uint32_t tile, uint32_t tile_count) const
 {
-    image.resize();
-    return image;
+    TRACE_EVENT();
+    image.colorizeTile(tile_count + tile, 2 * tile_count);
 }
 
 Image Transform::combine(Image a, Image b) const
 {
+    TRACE_EVENT();
+    a.copyTile(b, 1, 2);
     return a;
 }
@@ -2,11 +2,15 @@
 
 #include "Image.hpp"
 
+#include <cstdint>
+
 class Transform
 {
     public:
-        Image transform(const Image& image) const;
-        Image transform_upper(Image image) const;
-        Image transform_lower(Image image) const;
+        Image transform(Image image) const;
+        // Colorize the tile-th band of the upper/lower half, the bands of both halves can run in parallel
+        void transform_upper(Image& image, uint32_t tile, uint32_t tile_count) const;
+        void transform_lower(Image& image, uint32_t tile, uint32_t tile_count) const;
+        // Upper half is taken from `a`, lower half from `b`, the two have to be the same size
         Image combine(Image a, Image b) const;
 };
@@ -8,5 +8,7 @@ inline std::chrono::seconds one_read_eof {1};
 inline std::chrono::seconds one_read {5};
 inline std::chrono::seconds one_transform {2};
 inline std::chrono::seconds one_write {5};
+// The part of one_write paid once per write call, the rest scales with the bytes written
+inline std::chrono::seconds write_setup {1};
 inline std::chrono::seconds busy_operation {60};
 }
\ No newline at end of file
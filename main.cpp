@@ -1,23 +1,25 @@
-#include <optick.h>
+#include "Trace.hpp"
 #include "FakeServerDemo.hpp"
 #include "LibuvFakeServer.hpp"
+#include "DispatchBenchmark.hpp"
 constexpr const bool g_enable_capture = true;
 
 int main()
 {
     if constexpr(g_enable_capture)
     {
-        OPTICK_START_CAPTURE();
+        TRACE_START_CAPTURE();
     }
     {
-        OPTICK_FRAME("MainThread");
+        TRACE_FRAME("MainThread");
         runFakeServer();
         //runLibUvServer();
+        //runDispatchBenchmark();
     }
     if constexpr(g_enable_capture)
     {
-        OPTICK_STOP_CAPTURE();
-        OPTICK_SAVE_CAPTURE("OptickCapture.opt");
+        TRACE_STOP_CAPTURE();
+        TRACE_SAVE_CAPTURE("TraceCapture");
     }
     return 0;
 }
@@ -0,0 +1,124 @@
+#include "QueueScheduler.hpp"
+#include "SingleShotEvent.hpp"
+
+#include <array>
+#include <iostream>
+#include <optional>
+
+namespace
+{
+    using Queue = QueueScheduler<std::optional<int>>;
+
+    exec::task<int> completeOn(SingleShotEvent& event, int value)
+    {
+        co_await event;
+        co_return value;
+    }
+    void push(Queue& queue, SingleShotEvent& event, int value)
+    {
+        queue.push(completeOn(event, value) | stdexec::then([](int value) { return std::optional{value}; }));
+    }
+    bool check(bool condition, const char* what)
+    {
+        if(!condition)
+        {
+            std::cerr << "FAILED: " << what << std::endl;
+        }
+        return condition;
+    }
+
+    bool drain(Queue& queue, exec::async_scope& scope, int expected_popped, int popped)
+    {
+        queue.close();
+        while(std::optional<std::optional<int>> result = queue.tryTake())
+        {
+            if(!*result)
+            {
+                break;
+            }
+            ++popped;
+        }
+        stdexec::sync_wait(scope.on_empty());
+        return check(popped == expected_popped, "every frame is popped") & check(queue.empty(), "the queue is drained");
+    }
+
+    /*
+    The window of a Context stream: as many frames in flight as the queue capacity, a frame is pushed as soon as
+    one is popped. The newest frame always completes first, so the oldest one keeps its slot until the end.
+    */
+    bool unorderedWithSaturatedWindow()
+    {
+        static constexpr const uint32_t CAPACITY = 2;
+        static constexpr const int FRAMES = 16;
+        exec::async_scope scope;
+        Queue queue(&scope, QueueOrder::Unordered, CAPACITY);
+        std::array<SingleShotEvent, FRAMES> events;
+        bool ok = true;
+        int popped = 0;
+        try
+        {
+            push(queue, events[0], 0);
+            push(queue, events[1], 1);
+            for(int next = 2; next < FRAMES; ++next)
+            {
+                events[next - 1].set();
+                const std::optional<std::optional<int>> result = queue.tryTake();
+                ok &= check(result && *result == next - 1, "the completed frame is popped first");
+                ++popped;
+                push(queue, events[next], next);
+            }
+        }
+        catch(const std::exception& error)
+        {
+            ok &= check(false, error.what());
+        }
+        events[FRAMES - 1].set();
+        events[0].set();
+        return drain(queue, scope, FRAMES, popped) && ok;
+    }
+    // The frames completed out of order wait in the reorder ring for the oldest one
+    bool strictWithSaturatedWindow()
+    {
+        static constexpr const uint32_t CAPACITY = 2;
+        static constexpr const int FRAMES = 16;
+        exec::async_scope scope;
+        Queue queue(&scope, QueueOrder::Strict, CAPACITY);
+        std::array<SingleShotEvent, FRAMES> events;
+        bool ok = true;
+        int popped = 0;
+        try
+        {
+            for(int first = 0; first < FRAMES; first += CAPACITY)
+            {
+                push(queue, events[first], first);
+                push(queue, events[first + 1], first + 1);
+                events[first + 1].set();
+                ok &= check(queue.tryTake().has_value() == false, "the newer frame waits for the older one");
+                events[first].set();
+                for(int expected = first; expected < first + 2; ++expected)
+                {
+                    const std::optional<std::optional<int>> result = queue.tryTake();
+                    ok &= check(result && *result == expected, "the frames are popped in push order");
+                    ++popped;
+                }
+            }
+        }
+        catch(const std::exception& error)
+        {
+            ok &= check(false, error.what());
+        }
+        for(SingleShotEvent& event : events)
+        {
+            event.set();
+        }
+        return drain(queue, scope, FRAMES, popped) && ok;
+    }
+}
+
+int main()
+{
+    bool ok = true;
+    ok &= unorderedWithSaturatedWindow();
+    ok &= strictWithSaturatedWindow();
+    return ok ? 0 : 1;
+}
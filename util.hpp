@@ -1,5 +1,8 @@
 #pragma once
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <string>
 
 #include <thread>
 #include <format>
@@ -12,11 +15,11 @@ inline void busyWait(const std::chrono::milliseconds& duration)
     while(clock::now() < end_time) { fake_task = fake_task + 1; }
 }
 
+// A sequential number instead of the formatted std::thread::id, the name is built once per thread
 inline std::string getThreadIdStr()
 {
-    std::ostringstream os;
-    os << "Thread: " << std::this_thread::get_id();
-    return os.str();
+    static std::atomic<uint32_t> s_next_thread_id {1};
+    return "Thread: " + std::to_string(s_next_thread_id.fetch_add(1, std::memory_order_relaxed));
 }
 
 inline thread_local const std::string g_thread_name = getThreadIdStr();
\ No newline at end of file